@@ -0,0 +1,329 @@
+#include <QDir>
+#include <QFile>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AreaInformation.h"
+#include "AreaLabeller.h"
+#include "BitMask.h"
+#include "ContourTracer.h"
+#include "LineSimplifier.h"
+#include "RamerDouglasPeucker.h"
+#include "RegionAdjacencyGraph.h"
+#include "SvgBuilder.h"
+#include "ThreadPool.h"
+#include "Threshold.h"
+
+// Runs every stage of the pipeline in isolation and repeatedly on a synthetic image of controlled size and area count.
+// Each stage gets the output of the previous one as input, prepared outside of the measurement.
+// Usage: stageBenchmark [width] [height] [areas] [repetitions] [threads]
+
+namespace {
+	std::atomic<std::size_t> allocationCount(0);
+}
+
+void* operator new(std::size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* const memory = std::malloc((size > 0) ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+namespace {
+	int const colourThreshold = 64;
+	int const areaSizeThreshold = 50;
+	double const epsilon = 1.0;
+	double const deduplicationEpsilon = 2.0;
+
+	struct StageTimings {
+		double medianMs;
+		double p95Ms;
+		std::size_t allocations;
+	};
+
+	// setup runs untimed before every repetition, run is timed. Allocations are the median per repetition.
+	template<typename Setup, typename Run>
+	StageTimings measureStage(int repetitions, Setup const& setup, Run const& run) {
+		std::vector<double> timings;
+		std::vector<std::size_t> allocations;
+		for (int i = 0; i < repetitions; ++i) {
+			setup();
+			std::size_t const allocationsBefore = allocationCount.load();
+			auto const start = std::chrono::steady_clock::now();
+			run();
+			auto const end = std::chrono::steady_clock::now();
+			allocations.push_back(allocationCount.load() - allocationsBefore);
+			timings.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		std::sort(timings.begin(), timings.end());
+		std::sort(allocations.begin(), allocations.end());
+		std::size_t const p95Index = static_cast<std::size_t>(std::ceil(0.95 * timings.size())) - 1;
+		return { timings[timings.size() / 2], timings[p95Index], allocations[allocations.size() / 2] };
+	}
+
+	template<typename Run>
+	StageTimings measureStage(int repetitions, Run const& run) {
+		return measureStage(repetitions, []() {}, run);
+	}
+
+	// units is the amount of work per run, in millions of unitName
+	void printStage(char const* name, StageTimings const& timings, double units, char const* unitName) {
+		std::cout << name << ": median " << timings.medianMs << "ms, p95 " << timings.p95Ms << "ms, " << (units / (timings.medianMs / 1000.0)) << " " << unitName << "/s, " << timings.allocations << " allocations" << std::endl;
+	}
+
+	std::size_t countPoints(std::vector<std::vector<std::vector<Point>>> const& listOfLinesPerArea) {
+		std::size_t pointCount = 0;
+		for (auto const& lines : listOfLinesPerArea) {
+			for (auto const& line : lines) {
+				pointCount += line.size();
+			}
+		}
+		return pointCount;
+	}
+
+	std::size_t countPoints(std::vector<std::vector<Point>> const& lines) {
+		std::size_t pointCount = 0;
+		for (auto const& line : lines) {
+			pointCount += line.size();
+		}
+		return pointCount;
+	}
+
+	/*
+		A checkerboard of about areaCount cells with wavy borders, so the outlines are not just straight lines.
+		Every cell also gets a 2x2 speck of the other colour, which is below the area size threshold and merged away.
+	*/
+	std::vector<std::uint32_t> makeImage(int width, int height, int areaCount) {
+		double const cellSize = std::max(4.0, std::sqrt((static_cast<double>(width) * height) / std::max(1, areaCount)));
+		double const amplitude = cellSize / 8.0;
+		double const period = cellSize / 2.0;
+		std::uint32_t const black = 0xFF000000u;
+		std::uint32_t const white = 0xFFFFFFFFu;
+
+		std::vector<std::uint32_t> pixels(static_cast<std::size_t>(width) * height);
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				int const cellX = static_cast<int>(std::floor((x + amplitude * std::sin(y / period)) / cellSize));
+				int const cellY = static_cast<int>(std::floor((y + amplitude * std::sin(x / period)) / cellSize));
+				pixels[static_cast<std::size_t>(y) * width + x] = ((cellX + cellY) & 1) ? white : black;
+			}
+		}
+
+		std::mt19937 generator(42);
+		int const cellsX = static_cast<int>(std::ceil(width / cellSize));
+		int const cellsY = static_cast<int>(std::ceil(height / cellSize));
+		std::uniform_real_distribution<double> offset(0.25 * cellSize, 0.75 * cellSize);
+		for (int cellY = 0; cellY < cellsY; ++cellY) {
+			for (int cellX = 0; cellX < cellsX; ++cellX) {
+				int const x = static_cast<int>(cellX * cellSize + offset(generator));
+				int const y = static_cast<int>(cellY * cellSize + offset(generator));
+				if ((x + 1 >= width) || (y + 1 >= height)) {
+					continue;
+				}
+				std::uint32_t const colour = (pixels[static_cast<std::size_t>(y) * width + x] == white) ? black : white;
+				for (int dy = 0; dy < 2; ++dy) {
+					for (int dx = 0; dx < 2; ++dx) {
+						pixels[static_cast<std::size_t>(y + dy) * width + x + dx] = colour;
+					}
+				}
+			}
+		}
+		return pixels;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	int const width = (argc > 1) ? std::atoi(argv[1]) : 3000;
+	int const height = (argc > 2) ? std::atoi(argv[2]) : 2000;
+	int const areaCount = (argc > 3) ? std::atoi(argv[3]) : 2000;
+	int const repetitions = std::max(1, (argc > 4) ? std::atoi(argv[4]) : 11);
+	int threadCount = (argc > 5) ? std::atoi(argv[5]) : 1;
+	if (threadCount <= 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	double const megaPixels = (static_cast<double>(width) * height) / 1e6;
+
+	std::vector<std::uint32_t> const pixels = makeImage(width, height, areaCount);
+	ThreadPool threadPool(threadCount);
+	std::cout << "Benchmarking the stages on a " << width << " x " << height << " image with about " << areaCount << " areas, " << repetitions << " runs each on " << threadCount << " thread(s)." << std::endl;
+
+	ImageView const image = { reinterpret_cast<std::uint8_t const*>(pixels.data()), width, height, static_cast<std::size_t>(width) * sizeof(std::uint32_t), PixelFormat::Rgb32, {} };
+	BitMask imageBw(width, height);
+	StageTimings const thresholdTimings = measureStage(repetitions, [&]() {
+		thresholdImage(image, colourThreshold, imageBw);
+	});
+	printStage((std::string("threshold (") + ImageThresholder(image, colourThreshold).getKernelName() + ")").c_str(), thresholdTimings, megaPixels, "MPixel");
+
+	// The same image in the other formats the pipeline reads without converting
+	std::vector<std::uint8_t> rgbBytes(pixels.size() * 3);
+	std::vector<std::uint8_t> greyBytes(pixels.size());
+	std::vector<std::uint8_t> indexBytes(pixels.size());
+	for (std::size_t i = 0; i < pixels.size(); ++i) {
+		rgbBytes[3 * i] = static_cast<std::uint8_t>(pixels[i] >> 16);
+		rgbBytes[3 * i + 1] = static_cast<std::uint8_t>(pixels[i] >> 8);
+		rgbBytes[3 * i + 2] = static_cast<std::uint8_t>(pixels[i]);
+		greyBytes[i] = static_cast<std::uint8_t>(pixels[i]);
+		indexBytes[i] = (greyBytes[i] > colourThreshold) ? 1 : 0;
+	}
+	ImageView const formatImages[] = {
+		{ rgbBytes.data(), width, height, static_cast<std::size_t>(width) * 3, PixelFormat::Rgb888, {} },
+		{ greyBytes.data(), width, height, static_cast<std::size_t>(width), PixelFormat::Grayscale8, {} },
+		{ indexBytes.data(), width, height, static_cast<std::size_t>(width), PixelFormat::Indexed8, { 0xFF000000u, 0xFFFFFFFFu } }
+	};
+	BitMask formatImageBw(width, height);
+	for (ImageView const& formatImage : formatImages) {
+		StageTimings const formatThresholdTimings = measureStage(repetitions, [&]() {
+			thresholdImage(formatImage, colourThreshold, formatImageBw);
+		});
+		printStage((std::string("threshold (") + ImageThresholder(formatImage, colourThreshold).getKernelName() + ")").c_str(), formatThresholdTimings, megaPixels, "MPixel");
+	}
+
+	// The picture shrunk to its middle, in a frame of the top left colour, so every border pixel is compared once
+	std::vector<std::uint32_t> framedPixels(pixels.size(), pixels[0]);
+	for (int y = height / 4; y < height - height / 4; ++y) {
+		std::size_t const rowStart = static_cast<std::size_t>(y) * width;
+		std::copy(pixels.begin() + rowStart + width / 4, pixels.begin() + rowStart + width - width / 4, framedPixels.begin() + rowStart + width / 4);
+	}
+	ImageView const framedImage = { reinterpret_cast<std::uint8_t const*>(framedPixels.data()), width, height, static_cast<std::size_t>(width) * sizeof(std::uint32_t), PixelFormat::Rgb32, {} };
+	StageTimings const contentBoxTimings = measureStage(repetitions, [&]() {
+		findContentBox(framedImage);
+	});
+	printStage("content box (framed)", contentBoxTimings, megaPixels, "MPixel");
+
+	AreaInformation areaInformation(width, height);
+	for (LabellerType labellerType : { LabellerType::Runs, LabellerType::Pixel }) {
+		StageTimings const labellingTimings = measureStage(repetitions, [&]() {
+			areaInformation.reset();
+		}, [&]() {
+			labelAreas(labellerType, imageBw, areaInformation, threadPool);
+		});
+		printStage((labellerType == LabellerType::Runs) ? "labelling (runs)" : "labelling (pixel)", labellingTimings, megaPixels, "MPixel");
+	}
+
+	// Both of the above in one pass, without a mask
+	AreaInformation fusedAreas(width, height);
+	StageTimings const fusedTimings = measureStage(repetitions, [&]() {
+		fusedAreas.reset();
+	}, [&]() {
+		thresholdAndLabelAreas(image, colourThreshold, nullptr, fusedAreas, threadPool);
+	});
+	printStage("threshold and labelling (fused)", fusedTimings, megaPixels, "MPixel");
+
+	AreaInformation packedAreas(0, 0);
+	StageTimings const packTimings = measureStage(repetitions, [&]() {
+		packedAreas = areaInformation;
+	}, [&]() {
+		packedAreas.packAreas();
+	});
+	printStage("packAreas", packTimings, megaPixels, "MPixel");
+	std::cout << "\t" << areaInformation.getAreaCount() << " labelled areas, " << packedAreas.getAreaCount() << " after packing." << std::endl;
+
+	AreaInformation mergedAreas(0, 0);
+	StageTimings const mergeTimings = measureStage(repetitions, [&]() {
+		mergedAreas = packedAreas;
+	}, [&]() {
+		RegionAdjacencyGraph adjacencyGraph(mergedAreas);
+		adjacencyGraph.absorbSmallAreas(areaSizeThreshold, mergedAreas);
+		mergedAreas.packAreas();
+	});
+	printStage("small area merging", mergeTimings, megaPixels, "MPixel");
+	std::cout << "\t" << mergedAreas.getAreaCount() << " areas of at least " << areaSizeThreshold << " pixels." << std::endl;
+
+	std::vector<std::vector<std::vector<Point>>> listOfLinesPerArea;
+	StageTimings const contourTimings = measureStage(repetitions, [&]() {
+		listOfLinesPerArea = traceContoursPerArea(mergedAreas);
+	});
+	printStage("line forming (contour)", contourTimings, megaPixels, "MPixel");
+
+	StageTimings const pointSearchTimings = measureStage(repetitions, [&]() {
+		listOfLinesPerArea = mergedAreas.getListOfLinesPerArea();
+	});
+	printStage("line forming (points)", pointSearchTimings, megaPixels, "MPixel");
+	std::size_t const pointCount = countPoints(listOfLinesPerArea);
+	std::cout << "\t" << pointCount << " points." << std::endl;
+
+	std::vector<std::vector<Point> const*> keptLines;
+	StageTimings const deduplicationTimings = measureStage(repetitions, [&]() {
+		keptLines = deduplicateLines(listOfLinesPerArea, deduplicationEpsilon);
+	});
+	printStage("deduplication", deduplicationTimings, pointCount / 1e6, "MPoint");
+
+	std::size_t keptPointCount = 0;
+	for (auto const line : keptLines) {
+		keptPointCount += line->size();
+	}
+	std::vector<std::vector<Point>> outLines;
+	StageTimings const rdpTimings = measureStage(repetitions, [&]() {
+		outLines = simplifyLines(keptLines, epsilon, threadPool);
+	});
+	printStage("RamerDouglasPeucker", rdpTimings, keptPointCount / 1e6, "MPoint");
+	std::size_t const outPointCount = countPoints(outLines);
+	std::cout << "\t" << keptLines.size() << " lines, " << keptPointCount << " points simplified to " << outPointCount << "." << std::endl;
+
+	// Short lines in front of a last line that is split on its own still have to be simplified
+	std::vector<Point> shortLine;
+	std::vector<Point> longLine;
+	for (int i = 0; i < 5; ++i) {
+		shortLine.push_back(std::make_pair(i, (i % 2) * 10.0));
+	}
+	for (std::size_t i = 0; i < 4 * rdpParallelGrainSize; ++i) {
+		longLine.push_back(std::make_pair(static_cast<double>(i), (i % 3) * 10.0));
+	}
+	std::vector<std::vector<Point>> const checkLines = simplifyLines({ &shortLine, &longLine }, epsilon, threadPool);
+	if (checkLines[0].empty() || checkLines[1].empty()) {
+		std::cerr << "A line was left out by simplifyLines()!" << std::endl;
+		return 1;
+	}
+
+	StageTimings const svgBuildTimings = measureStage(repetitions, [&]() {
+		SvgBuilder svgBuilder(width, height, 297.0, 210.0, 0, 0);
+		QString const svg = svgBuilder.buildSvgFromLines(outLines);
+	});
+	printStage("SvgBuilder (string)", svgBuildTimings, outPointCount / 1e6, "MPoint");
+
+	QString const svgFileName = QDir::temp().filePath("stageBenchmark.svg");
+	StageTimings const svgWriteTimings = measureStage(repetitions, [&]() {
+		SvgBuilder svgBuilder(width, height, 297.0, 210.0, 0, 0);
+		QFile svgFile(svgFileName);
+		if (!svgFile.open(QFile::WriteOnly) || !svgBuilder.writeSvgFromLines(outLines, svgFile)) {
+			std::cerr << "Failed to write SVG output!" << std::endl;
+			std::exit(1);
+		}
+	});
+	printStage("SvgBuilder (file)", svgWriteTimings, outPointCount / 1e6, "MPoint");
+	QFile::remove(svgFileName);
+
+	return 0;
+}
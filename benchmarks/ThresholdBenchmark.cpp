@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "BitMask.h"
+#include "Threshold.h"
+
+// Compares the threshold kernels against the original std::vector<bool> loop on a synthetic 32bit image.
+// Usage: thresholdBenchmark [width] [height] [repetitions] [colourThreshold]
+
+namespace {
+	// The loop detectAreas used before the kernels existed.
+	void thresholdLegacy(std::vector<std::uint32_t> const& pixels, int width, int height, int colourThreshold, std::vector<bool>& imageBw) {
+		for (int h = 0; h < height; ++h) {
+			std::uint32_t const* line = pixels.data() + static_cast<std::size_t>(h) * width;
+			for (int w = 0; w < width; ++w) {
+				std::uint32_t const rgb = line[w];
+				int const red = (rgb >> 16) & 0xFF;
+				int const green = (rgb >> 8) & 0xFF;
+				int const blue = rgb & 0xFF;
+				imageBw[h * width + w] = (red > colourThreshold && green > colourThreshold && blue > colourThreshold);
+			}
+		}
+	}
+
+	template<typename Function>
+	double measureMedianMs(int repetitions, Function const& function) {
+		std::vector<double> timings;
+		for (int i = 0; i < repetitions; ++i) {
+			auto const start = std::chrono::steady_clock::now();
+			function();
+			auto const end = std::chrono::steady_clock::now();
+			timings.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		std::sort(timings.begin(), timings.end());
+		return timings[timings.size() / 2];
+	}
+}
+
+int main(int argc, char* argv[]) {
+	int const width = (argc > 1) ? std::atoi(argv[1]) : 6000;
+	int const height = (argc > 2) ? std::atoi(argv[2]) : 4000;
+	int const repetitions = (argc > 3) ? std::atoi(argv[3]) : 11;
+	int const colourThreshold = (argc > 4) ? std::atoi(argv[4]) : 64;
+	double const megaPixels = (static_cast<double>(width) * height) / 1e6;
+
+	std::vector<std::uint32_t> pixels(static_cast<std::size_t>(width) * height);
+	std::mt19937 generator(42);
+	std::uniform_int_distribution<std::uint32_t> distribution;
+	for (auto it = pixels.begin(); it != pixels.end(); ++it) {
+		*it = distribution(generator) | 0xFF000000u;
+	}
+	std::cout << "Thresholding a " << width << " x " << height << " image, median of " << repetitions << " runs." << std::endl;
+
+	std::vector<bool> imageBw(static_cast<std::size_t>(width) * height, false);
+	double const legacyMs = measureMedianMs(repetitions, [&]() {
+		thresholdLegacy(pixels, width, height, colourThreshold, imageBw);
+	});
+	std::cout << "legacy std::vector<bool>: " << legacyMs << "ms (" << (megaPixels / (legacyMs / 1000.0)) << " MPixel/s)" << std::endl;
+
+	for (ThresholdKernel kernel : { ThresholdKernel::Scalar, ThresholdKernel::Sse2, ThresholdKernel::Avx2 }) {
+		if (!isThresholdKernelSupported(kernel)) {
+			std::cout << getThresholdKernelName(kernel) << ": not supported on this CPU" << std::endl;
+			continue;
+		}
+
+		BitMask mask(width, height);
+		double const kernelMs = measureMedianMs(repetitions, [&]() {
+			for (int y = 0; y < height; ++y) {
+				thresholdRow(kernel, pixels.data() + static_cast<std::size_t>(y) * width, width, colourThreshold, mask.getRow(y));
+			}
+		});
+
+		bool matches = true;
+		for (int y = 0; (y < height) && matches; ++y) {
+			for (int x = 0; x < width; ++x) {
+				if (mask.get(x, y) != imageBw[static_cast<std::size_t>(y) * width + x]) {
+					matches = false;
+					break;
+				}
+			}
+		}
+		std::cout << getThresholdKernelName(kernel) << ": " << kernelMs << "ms (" << (megaPixels / (kernelMs / 1000.0)) << " MPixel/s, " << (legacyMs / kernelMs) << "x) " << (matches ? "matches" : "MISMATCH") << std::endl;
+		if (!matches) {
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -1,66 +1,111 @@
 #include "AreaInformation.h"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <iostream>
 #include <set>
 #include <stack>
 
-AreaInformation::AreaInformation(int width, int height) : m_w(width), m_h(height), m_areas(width* height, -1), m_mergedAreas(), m_areaCounter(0) {
+AreaInformation::AreaInformation(int width, int height) : m_w(width), m_h(height), m_areas(width* height, -1), m_narrowAreas(), m_hasNarrowLabels(false), m_areaUnionFind(), m_areaCounter(0), m_areaMembers(), m_neighbourEdges(), m_boundaryFlags(0, 0), m_hasBoundaryFlags(false) {
 	//
 }
 
+void AreaInformation::reset() {
+	// Packing may have narrowed the labels, labelling needs the wide ones again
+	m_areas.assign(static_cast<std::size_t>(m_w) * m_h, -1);
+	std::vector<std::uint16_t>().swap(m_narrowAreas);
+	m_hasNarrowLabels = false;
+	m_areaUnionFind.clear();
+	m_areaCounter = 0;
+	m_areaMembers.clear();
+	m_neighbourEdges.clear();
+	m_hasBoundaryFlags = false;
+}
+
 int AreaInformation::getArea(int x, int y) const {
-	int const area = m_areas.at(posToVec(x, y, m_w));
+	std::size_t const index = posToVec(x, y, m_w);
+	int const area = m_hasNarrowLabels ? m_narrowAreas.at(index) : m_areas.at(index);
 	assert(area >= 0 && "Internal Error: Area was not set yet!");
 	return resolveArea(area);
 }
 
 void AreaInformation::setArea(int x, int y, int area) {
-	assert((m_mergedAreas.find(area) == m_mergedAreas.cend()) && "Internal Error: Used area was not unmerged!");
-	m_areas[posToVec(x, y, m_w)] = area;
-
-	// Check surrounding neighbours
-	bool const isTopDifferent = (y > 0) && (getArea(x, y - 1) != area);
-	if (isTopDifferent) {
-		m_areaNeighbours[area].insert(getArea(x, y - 1));
+	assert((m_areaUnionFind.find(area) == area) && "Internal Error: Used area was not unmerged!");
+	assert(!m_hasNarrowLabels && "Internal Error: Packed areas can not be labelled again!");
+	std::size_t const index = posToVec(x, y, m_w);
+	m_areas[index] = area;
+
+	// Check surrounding neighbours, both are set already
+	if (y > 0) {
+		int const topArea = resolveArea(m_areas[index - m_w]);
+		if (topArea != area) {
+			addNeighbourEdge(area, topArea);
+		}
 	}
-	bool const isLeftDifferent = (x > 0) && (getArea(x - 1, y) != area);
-	if (isLeftDifferent) {
-		m_areaNeighbours[area].insert(getArea(x - 1, y));
+	if (x > 0) {
+		int const leftArea = resolveArea(m_areas[index - 1]);
+		if (leftArea != area) {
+			addNeighbourEdge(area, leftArea);
+		}
 	}
 
 	m_areaMembers[area]++;
 }
 
+int const* AreaInformation::getAreaRow(int y) const {
+	assert(!m_hasNarrowLabels && "Internal Error: The labels are narrow, use getNarrowAreaRow()!");
+	return m_areas.data() + posToVec(0, y, m_w);
+}
+
+bool AreaInformation::hasNarrowLabels() const {
+	return m_hasNarrowLabels;
+}
+
+std::uint16_t const* AreaInformation::getNarrowAreaRow(int y) const {
+	assert(m_hasNarrowLabels && "Internal Error: The labels are wide, use getAreaRow()!");
+	return m_narrowAreas.data() + posToVec(0, y, m_w);
+}
+
+void AreaInformation::setAreaRun(int y, int xBegin, int xEnd, int area) {
+	assert((m_areaUnionFind.find(area) == area) && "Internal Error: Used area was not unmerged!");
+	assert(!m_hasNarrowLabels && "Internal Error: Packed areas can not be labelled again!");
+	auto const rowStart = m_areas.begin() + posToVec(0, y, m_w);
+	std::fill(rowStart + xBegin, rowStart + xEnd, area);
+	m_areaMembers[area] += xEnd - xBegin;
+}
+
+void AreaInformation::addAreaNeighbour(int area, int neighbour) {
+	addNeighbourEdge(area, neighbour);
+}
+
 int AreaInformation::resolveArea(int area) const {
-	auto it = m_mergedAreas.find(area);
-	while (it != m_mergedAreas.cend()) {
-		area = it->second;
-		it = m_mergedAreas.find(area);
-	}
-	return area;
+	return m_areaUnionFind.find(area);
 }
 
 int AreaInformation::mergeAreas(int topArea, int leftArea) {
-	m_mergedAreas.insert(std::make_pair(topArea, leftArea));
-	for (auto it = m_mergedAreas.begin(); it != m_mergedAreas.end(); ++it) {
-		if (it->second == topArea) {
-			it->second = leftArea;
-		}
+	int const topRoot = resolveArea(topArea);
+	int const leftRoot = resolveArea(leftArea);
+	if (topRoot == leftRoot) {
+		return leftRoot;
 	}
-	m_areaMembers[leftArea] += m_areaMembers[topArea];
-	m_areaNeighbours[leftArea].insert(m_areaNeighbours[topArea].cbegin(), m_areaNeighbours[topArea].cend());
-	return leftArea;
+
+	// Union by size decides the survivor and the member counts move with it. The neighbour edges stay as they are and resolve later.
+	int const survivor = m_areaUnionFind.unite(topRoot, leftRoot);
+	int const absorbed = (survivor == topRoot) ? leftRoot : topRoot;
+	m_areaMembers[survivor] += m_areaMembers[absorbed];
+	m_areaMembers[absorbed] = 0;
+
+	return survivor;
 }
 
 int AreaInformation::addArea() {
 	int const newArea = m_areaCounter;
 	++m_areaCounter;
+	m_areaUnionFind.addArea();
+	assert(m_areaUnionFind.getAreaCount() == m_areaCounter && "Internal Error: Area Counter and union-find out of sync!");
 	m_areaMembers.push_back(0);
 	assert(m_areaMembers.size() == m_areaCounter && "Internal Error: Area Counter and membership vector out of sync!");
-	m_areaNeighbours.push_back({});
-	assert(m_areaNeighbours.size() == m_areaCounter && "Internal Error: Area Counter and neighbour vector out of sync!");
 	return newArea;
 }
 
@@ -68,42 +113,169 @@ int AreaInformation::getAreaCount() const {
 	return m_areaCounter;
 }
 
+int AreaInformation::getWidth() const {
+	return m_w;
+}
+
+int AreaInformation::getHeight() const {
+	return m_h;
+}
+
 int AreaInformation::getAreaMemberCount(int area) const {
-	return m_areaMembers.at(area);
+	return m_areaMembers.at(resolveArea(area));
 }
 
-int AreaInformation::getLargestNeighbourArea(int area) const {
-	int largestNeighbourAreaId = -1;
-	int largestNeighbourSize = -1;
-	for (auto it = m_areaNeighbours[area].cbegin(); it != m_areaNeighbours[area].cend(); ++it) {
-		int const neighbourSize = getAreaMemberCount(*it);
-		if (neighbourSize > largestNeighbourSize) {
-			largestNeighbourSize = neighbourSize;
-			largestNeighbourAreaId = *it;
-		}
+void AreaInformation::addAreaMembers(int area, int count) {
+	m_areaMembers.at(resolveArea(area)) += count;
+}
+
+std::vector<std::pair<int, int>> const& AreaInformation::getNeighbourEdges() const {
+	return m_neighbourEdges;
+}
+
+bool AreaInformation::hasBoundaryFlags() const {
+	return m_hasBoundaryFlags;
+}
+
+BitMask const& AreaInformation::getBoundaryFlags() const {
+	assert(m_hasBoundaryFlags && "Internal Error: No boundary flags were set!");
+	return m_boundaryFlags;
+}
+
+BitMask& AreaInformation::prepareBoundaryFlags() {
+	if ((m_boundaryFlags.getWidth() != m_w) || (m_boundaryFlags.getHeight() != m_h)) {
+		m_boundaryFlags = BitMask(m_w, m_h);
+	} else if (m_h > 0) {
+		std::fill(m_boundaryFlags.getRow(0), m_boundaryFlags.getRow(0) + static_cast<std::size_t>(m_boundaryFlags.getWordsPerRow()) * m_h, 0);
 	}
-	return largestNeighbourAreaId;
+	m_hasBoundaryFlags = true;
+	return m_boundaryFlags;
 }
 
-AreaInformation AreaInformation::packAreas() const {
-	AreaInformation result(m_w, m_h);		
-	std::unordered_map<int, int> indexMap;
+void AreaInformation::packAreas() {
+	// Areas appended from bands may have been merged there already, they are roots here without any pixels
+	int rootCount = 0;
+	for (int area = 0; area < m_areaCounter; ++area) {
+		if ((resolveArea(area) == area) && (m_areaMembers[area] > 0)) {
+			++rootCount;
+		}
+	}
 
-	for (int w = 0; w < m_w; ++w) {
-		for (int h = 0; h < m_h; ++h) {
-			int const area = m_areas.at(posToVec(w, h, m_w));
-			assert(area >= 0 && "Internal Error: Area was not set yet!");
-			int const resolvedArea = resolveArea(area);
-				
-			if (indexMap.find(resolvedArea) == indexMap.cend()) {
-				indexMap.insert(std::make_pair(resolvedArea, result.addArea()));
+	// Every label remembers the packed number of its root, roots are numbered when they first show up
+	std::vector<int> packedAreas(m_areaCounter, -1);
+	std::vector<int> packedMembers;
+	packedMembers.reserve(rootCount);
+	auto const packArea = [this, &packedAreas, &packedMembers](int area) {
+		assert(area >= 0 && "Internal Error: Area was not set yet!");
+		int& packedArea = packedAreas[area];
+		if (packedArea < 0) {
+			int const root = resolveArea(area);
+			int& packedRoot = packedAreas[root];
+			if (packedRoot < 0) {
+				packedRoot = static_cast<int>(packedMembers.size());
+				packedMembers.push_back(m_areaMembers[root]);
 			}
-			result.setArea(w, h, indexMap.at(resolvedArea));
+			packedArea = packedRoot;
+		}
+		return packedArea;
+	};
+
+	if (m_hasNarrowLabels) {
+		for (auto it = m_narrowAreas.begin(); it != m_narrowAreas.end(); ++it) {
+			*it = static_cast<std::uint16_t>(packArea(*it));
+		}
+	} else if (rootCount <= narrowLabelLimit) {
+		std::vector<std::uint16_t> narrowAreas(m_areas.size());
+		for (std::size_t i = 0; i < m_areas.size(); ++i) {
+			narrowAreas[i] = static_cast<std::uint16_t>(packArea(m_areas[i]));
+		}
+		m_narrowAreas.swap(narrowAreas);
+		std::vector<int>().swap(m_areas);
+		m_hasNarrowLabels = true;
+	} else {
+		for (auto it = m_areas.begin(); it != m_areas.end(); ++it) {
+			*it = packArea(*it);
 		}
 	}
+
+	// The neighbours follow their areas, pairs that ended up in the same area are dropped
+	std::vector<std::pair<int, int>> neighbourEdges;
+	neighbourEdges.swap(m_neighbourEdges);
+	for (auto it = neighbourEdges.cbegin(); it != neighbourEdges.cend(); ++it) {
+		int const area = packArea(it->first);
+		int const neighbour = packArea(it->second);
+		if (area != neighbour) {
+			addNeighbourEdge(area, neighbour);
+		}
+	}
+
+	assert(packedMembers.size() == static_cast<std::size_t>(rootCount) && "Internal Error: Not every area has a pixel!");
+	m_areaMembers.swap(packedMembers);
+	m_areaCounter = rootCount;
+	m_areaUnionFind.clear();
+	m_areaUnionFind.reserve(rootCount);
+	for (int i = 0; i < rootCount; ++i) {
+		m_areaUnionFind.addArea();
+	}
+}
+
+AreaInformation AreaInformation::fromPackedLabels(int width, int height, std::vector<int> const& memberCounts, std::int32_t const* labels) {
+	return fromLabels(width, height, memberCounts, labels);
+}
+
+AreaInformation AreaInformation::fromPackedLabels(int width, int height, std::vector<int> const& memberCounts, std::uint16_t const* labels) {
+	return fromLabels(width, height, memberCounts, labels);
+}
+
+template <typename Label>
+AreaInformation AreaInformation::fromLabels(int width, int height, std::vector<int> const& memberCounts, Label const* labels) {
+	// Only the labels of the final width are allocated
+	AreaInformation result(0, 0);
+	result.m_w = width;
+	result.m_h = height;
+	result.m_areaUnionFind.reserve(memberCounts.size());
+	for (std::size_t i = 0; i < memberCounts.size(); ++i) {
+		result.addArea();
+	}
+	result.m_areaMembers = memberCounts;
+	std::size_t const pixelCount = static_cast<std::size_t>(width) * height;
+	if (memberCounts.size() <= narrowLabelLimit) {
+		// Narrow like packAreas() would have left them
+		result.m_narrowAreas.resize(pixelCount);
+		std::transform(labels, labels + pixelCount, result.m_narrowAreas.begin(), [](Label label) { return static_cast<std::uint16_t>(label); });
+		result.m_hasNarrowLabels = true;
+	} else {
+		result.m_areas.assign(labels, labels + pixelCount);
+	}
 	return result;
 }
 
+int AreaInformation::appendAreasOf(AreaInformation const& band) {
+	assert(band.m_w == m_w && "Internal Error: Band width does not match!");
+	int const areaOffset = m_areaCounter;
+	m_areaUnionFind.reserve(m_areaCounter + band.m_areaCounter);
+	for (int i = 0; i < band.m_areaCounter; ++i) {
+		int const area = addArea();
+		m_areaMembers[area] = band.m_areaMembers[i];
+	}
+	// Our union-find does not know the merges of the band, so its edges are resolved on the way
+	m_neighbourEdges.reserve(m_neighbourEdges.size() + band.m_neighbourEdges.size());
+	for (auto it = band.m_neighbourEdges.cbegin(); it != band.m_neighbourEdges.cend(); ++it) {
+		m_neighbourEdges.push_back(std::make_pair(band.resolveArea(it->first) + areaOffset, band.resolveArea(it->second) + areaOffset));
+	}
+	return areaOffset;
+}
+
+void AreaInformation::copyLabelsOf(AreaInformation const& band, int firstRow, int areaOffset) {
+	assert(band.m_w == m_w && "Internal Error: Band width does not match!");
+	assert(!m_hasNarrowLabels && !band.m_hasNarrowLabels && "Internal Error: Packed areas can not be labelled again!");
+	assert(firstRow + band.m_h <= m_h && "Internal Error: Band does not fit!");
+	auto const target = m_areas.begin() + posToVec(0, firstRow, m_w);
+	std::transform(band.m_areas.cbegin(), band.m_areas.cend(), target, [&band, areaOffset](int area) {
+		return band.resolveArea(area) + areaOffset;
+	});
+}
+
 #define LINESEARCH_NEIGHBOUR_COUNT 8u
 class LineSearchStackFrame {
 public:
@@ -199,25 +371,45 @@ std::vector<IPoint> AreaInformation::addPointIterative(IPoint const& start, std:
 }
 
 std::vector<std::vector<std::vector<Point>>> AreaInformation::getListOfLinesPerArea() const {
+	std::size_t maxStackSize = 0;
+	return getListOfLinesPerArea(maxStackSize);
+}
+
+std::vector<std::vector<std::vector<Point>>> AreaInformation::getListOfLinesPerArea(std::size_t& maxStackSize) const {
 	std::vector<std::vector<std::vector<Point>>> result;
 
 	std::vector<std::set<IPoint>> boundingsPoints;
 	boundingsPoints.resize(getAreaCount());
-	for (int w = 0; w < m_w; ++w) {
+	auto const addBoundingPoints = [this, &boundingsPoints](int w, int h) {
+		int const myArea = getArea(w, h);
+		if ((w > 0) && (getArea(w - 1, h) != myArea)) {
+			boundingsPoints[myArea].insert(std::make_pair(w, h));
+			boundingsPoints[getArea(w - 1, h)].insert(std::make_pair(w - 1, h));
+		}
+		if ((h > 0) && (getArea(w, h - 1) != myArea)) {
+			boundingsPoints[myArea].insert(std::make_pair(w, h));
+			boundingsPoints[getArea(w, h - 1)].insert(std::make_pair(w, h - 1));
+		}
+	};
+	if (m_hasBoundaryFlags) {
+		// Both pixels of a differing pair are flagged, so the unflagged ones can not add anything
 		for (int h = 0; h < m_h; ++h) {
-			int const myArea = getArea(w, h);
-			if ((w > 0) && (getArea(w - 1, h) != myArea)) {
-				boundingsPoints[myArea].insert(std::make_pair(w, h));
-				boundingsPoints[getArea(w - 1, h)].insert(std::make_pair(w - 1, h));
+			std::uint64_t const* flags = m_boundaryFlags.getRow(h);
+			for (int i = 0; i < m_boundaryFlags.getWordsPerRow(); ++i) {
+				for (std::uint64_t word = flags[i]; word != 0; word &= word - 1) {
+					addBoundingPoints(i * 64 + BitMask::countTrailingZeros(word), h);
+				}
 			}
-			if ((h > 0) && (getArea(w, h - 1) != myArea)) {
-				boundingsPoints[myArea].insert(std::make_pair(w, h));
-				boundingsPoints[getArea(w, h - 1)].insert(std::make_pair(w, h - 1));
+		}
+	} else {
+		for (int h = 0; h < m_h; ++h) {
+			for (int w = 0; w < m_w; ++w) {
+				addBoundingPoints(w, h);
 			}
 		}
 	}
 
-	std::size_t maxStackSize = 0;
+	maxStackSize = 0;
 	for (int i = 0; i < boundingsPoints.size(); ++i) {
 		std::set<IPoint> points = boundingsPoints.at(i);
 		std::vector<std::vector<Point>> orderedPointsList;
@@ -238,7 +430,5 @@ std::vector<std::vector<std::vector<Point>>> AreaInformation::getListOfLinesPerA
 
 		result.push_back(orderedPointsList);
 	}
-	std::cout << "Maximum stack depth was " << maxStackSize << "." << std::endl;
-
 	return result;
 }
@@ -4,11 +4,11 @@
 #include <cmath>
 #include <cstdint>
 #include <list>
-#include <unordered_map>
-#include <unordered_set>
 #include <set>
 #include <vector>
 
+#include "AreaUnionFind.h"
+#include "BitMask.h"
 #include "Point.h"
 
 typedef std::pair<int, int> IPoint;
@@ -17,10 +17,26 @@ class AreaInformation {
 public:
 	AreaInformation(int width, int height);
 
+	// Forgets all areas and labels, keeping the allocated memory for the next image of the same size.
+	void reset();
+
 	int getArea(int x, int y) const;
 
 	void setArea(int x, int y, int area);
 
+	// The labels of row y as stored, they are only resolved areas for packed areas. Only for wide labels, see hasNarrowLabels().
+	int const* getAreaRow(int y) const;
+
+	// Packed areas keep 16bit labels when there are few enough of them, read them through getNarrowAreaRow() then.
+	bool hasNarrowLabels() const;
+
+	std::uint16_t const* getNarrowAreaRow(int y) const;
+
+	// Assigns area to the pixels [xBegin, xEnd) of row y. Neighbours are not derived, see addAreaNeighbour().
+	void setAreaRun(int y, int xBegin, int xEnd, int area);
+
+	void addAreaNeighbour(int area, int neighbour);
+
 	int resolveArea(int area) const;
 
 	int mergeAreas(int topArea, int leftArea);
@@ -29,14 +45,51 @@ public:
 
 	int getAreaCount() const;
 
+	int getWidth() const;
+
+	int getHeight() const;
+
 	int getAreaMemberCount(int area) const;
 
-	int getLargestNeighbourArea(int area) const;
+	// Counts pixels that have no label, e.g. those around a cropped image, as members of area
+	void addAreaMembers(int area, int count);
+
+	// Pairs of (area, neighbour) in the order they were seen directly above or left of a member of area.
+	// Only consecutive repeats are dropped and the ids may need resolving, RegionAdjacencyGraph turns them into the adjacency of the final areas.
+	std::vector<std::pair<int, int>> const& getNeighbourEdges() const;
+
+	// Numbers the resolved areas from 0 in the order they first appear row by row and rewrites the labels in place, in one pass.
+	// Up to narrowLabelLimit areas, the labels are narrowed to 16bit on the way and the wide ones are released.
+	void packAreas();
 
-	AreaInformation packAreas() const;
+	static int const narrowLabelLimit = 65536;
+
+	// Pixels with a 4-neighbour of the other colour, flagged by the labellers. Outlines between the final areas only run along them,
+	// so the line formers skip the rest a word at a time. Missing for areas rebuilt from packed labels.
+	bool hasBoundaryFlags() const;
+
+	BitMask const& getBoundaryFlags() const;
+
+	// Clears the boundary flags for a labeller to set and marks them as present.
+	BitMask& prepareBoundaryFlags();
+
+	// Rebuilds packed areas from their labels (row by row) and member counts, e.g. when loaded from a StageCache.
+	// The neighbours are not restored, they are only needed to merge areas before packing.
+	static AreaInformation fromPackedLabels(int width, int height, std::vector<int> const& memberCounts, std::int32_t const* labels);
+	static AreaInformation fromPackedLabels(int width, int height, std::vector<int> const& memberCounts, std::uint16_t const* labels);
+
+	// Appends the areas of a separately labelled band (member counts and neighbour edges) behind our own, returns the id offset they received.
+	int appendAreasOf(AreaInformation const& band);
+
+	// Copies the resolved labels of a band into our rows starting at firstRow, shifted by areaOffset.
+	// Only writes the band rows, so bands can be copied concurrently.
+	void copyLabelsOf(AreaInformation const& band, int firstRow, int areaOffset);
 
 	std::vector<std::vector<std::vector<Point>>> getListOfLinesPerArea() const;
 
+	// Same, also reporting the deepest stack the line search needed.
+	std::vector<std::vector<std::vector<Point>>> getListOfLinesPerArea(std::size_t& maxStackSize) const;
+
 	static inline std::size_t posToVec(int x, int y, int width) {
 		return y * width + x;
 	}
@@ -50,11 +103,26 @@ private:
 	int m_w;
 	int m_h;
 
+	// Labels while labelling, and of packed areas with too many areas for m_narrowAreas. Only one of them is in use.
 	std::vector<int> m_areas;
-	std::unordered_map<int, int> m_mergedAreas;
+	std::vector<std::uint16_t> m_narrowAreas;
+	bool m_hasNarrowLabels;
+	AreaUnionFind m_areaUnionFind;
 	int m_areaCounter;
 	std::vector<int> m_areaMembers;
-	std::vector<std::unordered_set<int>> m_areaNeighbours;
+	std::vector<std::pair<int, int>> m_neighbourEdges;
+	BitMask m_boundaryFlags;
+	bool m_hasBoundaryFlags;
+
+	inline void addNeighbourEdge(int area, int neighbour) {
+		std::pair<int, int> const edge(area, neighbour);
+		if (m_neighbourEdges.empty() || (m_neighbourEdges.back() != edge)) {
+			m_neighbourEdges.push_back(edge);
+		}
+	}
+
+	template <typename Label>
+	static AreaInformation fromLabels(int width, int height, std::vector<int> const& memberCounts, Label const* labels);
 
 	std::vector<IPoint> addPointIterative(IPoint const& start, std::set<IPoint>& points, std::size_t& maxStackSize) const;
 };
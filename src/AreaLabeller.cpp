@@ -0,0 +1,324 @@
+#include "AreaLabeller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "Log.h"
+#include "Threshold.h"
+
+void extractRuns(BitMask const& imageBw, int y, std::vector<Run>& runs) {
+	extractRuns(imageBw.getRow(y), imageBw.getWidth(), runs);
+}
+
+void extractRuns(std::uint64_t const* row, int width, std::vector<Run>& runs) {
+	runs.clear();
+	int const wordCount = (width + 63) / 64;
+	std::uint64_t const lastWordMask = ((width & 63) == 0) ? ~std::uint64_t(0) : ((std::uint64_t(1) << (width & 63)) - 1);
+	int begin = 0;
+	bool colour = (row[0] & 1u) != 0;
+
+	// A set bit in transitions marks a pixel differing from its left neighbour, so uniform words are skipped at once
+	std::uint64_t previousBit = row[0] & 1u;
+	for (int i = 0; i < wordCount; ++i) {
+		std::uint64_t const word = row[i];
+		std::uint64_t transitions = word ^ ((word << 1) | previousBit);
+		if (i == wordCount - 1) {
+			transitions &= lastWordMask;
+		}
+		previousBit = word >> 63;
+
+		while (transitions != 0) {
+			int const x = i * 64 + BitMask::countTrailingZeros(transitions);
+			runs.push_back({ begin, x, colour, -1 });
+			begin = x;
+			colour = !colour;
+			transitions &= transitions - 1;
+		}
+	}
+	runs.push_back({ begin, width, colour, -1 });
+}
+
+void flagBoundaryPixels(std::uint64_t const* row, std::uint64_t const* rowAbove, int width, std::uint64_t* flags, std::uint64_t* flagsAbove) {
+	int const wordCount = (width + 63) / 64;
+	std::uint64_t const lastWordMask = ((width & 63) == 0) ? ~std::uint64_t(0) : ((std::uint64_t(1) << (width & 63)) - 1);
+	if (wordCount == 0) {
+		return;
+	}
+
+	// Same transitions as in extractRuns(), a transition at x flags x and x - 1, which may be bit 63 of the word before
+	std::uint64_t transitions = row[0] ^ ((row[0] << 1) | (row[0] & 1u));
+	for (int i = 0; i < wordCount; ++i) {
+		if (i == wordCount - 1) {
+			transitions &= lastWordMask;
+		}
+		std::uint64_t const nextTransitions = (i + 1 < wordCount) ? (row[i + 1] ^ ((row[i + 1] << 1) | (row[i] >> 63))) : 0;
+		std::uint64_t boundary = transitions | (transitions >> 1) | (nextTransitions << 63);
+		if (rowAbove != nullptr) {
+			std::uint64_t const vertical = row[i] ^ rowAbove[i];
+			boundary |= vertical;
+			flagsAbove[i] |= vertical;
+		}
+		flags[i] |= boundary;
+		transitions = nextTransitions;
+	}
+}
+
+namespace {
+	// Rows of a finished mask
+	class MaskRows {
+	public:
+		explicit MaskRows(BitMask const& imageBw) : m_imageBw(imageBw) {
+			//
+		}
+
+		inline std::uint64_t const* getRow(int y) {
+			return m_imageBw.getRow(y);
+		}
+	private:
+		BitMask const& m_imageBw;
+	};
+
+	// Rows thresholded from the image as they are asked for, each exactly once. They go into imageBw if given, otherwise two row buffers
+	// take turns, so the row returned before stays valid as the one above.
+	class ThresholdedRows {
+	public:
+		ThresholdedRows(ImageView const& image, int colourThreshold, BitMask* imageBw) : m_thresholder(image, colourThreshold), m_imageBw(imageBw), m_rows((imageBw == nullptr) ? 2 * static_cast<std::size_t>((image.width + 63) / 64) : 0, 0) {
+			//
+		}
+
+		inline std::uint64_t const* getRow(int y) {
+			std::uint64_t* const words = (m_imageBw != nullptr) ? m_imageBw->getRow(y) : (m_rows.data() + (y & 1) * (m_rows.size() / 2));
+			m_thresholder.thresholdRow(y, words);
+			return words;
+		}
+	private:
+		ImageThresholder m_thresholder;
+		BitMask* m_imageBw;
+		std::vector<std::uint64_t> m_rows;
+	};
+
+	// Copies of the first and last row of a band, which its seams are joined along once the mask rows may be gone
+	struct BandRows {
+		std::vector<std::uint64_t> first;
+		std::vector<std::uint64_t> last;
+	};
+
+	template <typename RowSource>
+	void labelRowsByRuns(RowSource& rows, int firstRow, AreaInformation& areaInformation, BitMask& boundaryFlags, BandRows& bandRows) {
+		int const width = areaInformation.getWidth();
+		int const height = areaInformation.getHeight();
+		if (width <= 0) {
+			return;
+		}
+
+		std::vector<Run> previousRuns;
+		std::vector<Run> currentRuns;
+		std::vector<int> differentTopAreas;
+		std::uint64_t const* rowAbove = nullptr;
+		for (int y = 0; y < height; ++y) {
+			std::uint64_t const* const row = rows.getRow(firstRow + y);
+			extractRuns(row, width, currentRuns);
+			// The row above within the band only, the band above flags across the seam when it is joined
+			flagBoundaryPixels(row, rowAbove, width, boundaryFlags.getRow(firstRow + y), (y > 0) ? boundaryFlags.getRow(firstRow + y - 1) : nullptr);
+
+			std::size_t firstOverlap = 0;
+			for (std::size_t i = 0; i < currentRuns.size(); ++i) {
+				Run& run = currentRuns[i];
+				differentTopAreas.clear();
+
+				// Previous row runs are sorted, so skip the ones ending before us and walk the overlapping ones
+				while ((firstOverlap < previousRuns.size()) && (previousRuns[firstOverlap].end <= run.begin)) {
+					++firstOverlap;
+				}
+				for (std::size_t j = firstOverlap; (j < previousRuns.size()) && (previousRuns[j].begin < run.end); ++j) {
+					Run const& topRun = previousRuns[j];
+					if (topRun.colour != run.colour) {
+						differentTopAreas.push_back(topRun.area);
+					} else if (run.area == -1) {
+						run.area = areaInformation.resolveArea(topRun.area);
+					} else {
+						run.area = areaInformation.mergeAreas(topRun.area, run.area);
+					}
+				}
+				if (run.area == -1) {
+					run.area = areaInformation.addArea();
+				}
+
+				for (auto it = differentTopAreas.cbegin(); it != differentTopAreas.cend(); ++it) {
+					areaInformation.addAreaNeighbour(run.area, *it);
+				}
+				if (i > 0) {
+					areaInformation.addAreaNeighbour(run.area, currentRuns[i - 1].area);
+				}
+			}
+
+			// Merges may have happened after a run was assigned, so write back the final roots row-major
+			for (auto it = currentRuns.begin(); it != currentRuns.end(); ++it) {
+				it->area = areaInformation.resolveArea(it->area);
+				areaInformation.setAreaRun(y, it->begin, it->end, it->area);
+			}
+			previousRuns.swap(currentRuns);
+
+			if (y == 0) {
+				bandRows.first.assign(row, row + boundaryFlags.getWordsPerRow());
+			}
+			if (y == height - 1) {
+				bandRows.last.assign(row, row + boundaryFlags.getWordsPerRow());
+			}
+			rowAbove = row;
+		}
+	}
+
+	void labelBand(LabellerType labellerType, BitMask const& imageBw, int firstRow, AreaInformation& areaInformation, BitMask& boundaryFlags, BandRows& bandRows) {
+		switch (labellerType) {
+			case LabellerType::Pixel: {
+				int const lastRow = firstRow + areaInformation.getHeight() - 1;
+				labelAreasByPixel(imageBw, firstRow, areaInformation, boundaryFlags);
+				if (lastRow >= firstRow) {
+					bandRows.first.assign(imageBw.getRow(firstRow), imageBw.getRow(firstRow) + imageBw.getWordsPerRow());
+					bandRows.last.assign(imageBw.getRow(lastRow), imageBw.getRow(lastRow) + imageBw.getWordsPerRow());
+				}
+				break;
+			}
+			case LabellerType::Runs: {
+				MaskRows rows(imageBw);
+				labelRowsByRuns(rows, firstRow, areaInformation, boundaryFlags, bandRows);
+				break;
+			}
+		}
+	}
+
+	// Joins the areas across the border between row y - 1 and row y, the same way a single pass would have seen them.
+	void mergeSeam(std::uint64_t const* rowAbove, std::uint64_t const* row, int y, AreaInformation& areaInformation, BitMask& boundaryFlags) {
+		int const width = areaInformation.getWidth();
+		for (int x = 0; x < width; ++x) {
+			int const topArea = areaInformation.getArea(x, y - 1);
+			int const area = areaInformation.getArea(x, y);
+			if ((((rowAbove[x >> 6] ^ row[x >> 6]) >> (x & 63)) & 1u) == 0) {
+				areaInformation.mergeAreas(topArea, area);
+			} else {
+				areaInformation.addAreaNeighbour(area, topArea);
+			}
+		}
+		flagBoundaryPixels(row, rowAbove, width, boundaryFlags.getRow(y), boundaryFlags.getRow(y - 1));
+	}
+
+	// Labels the image in horizontal bands with labelBand(firstRow, band, boundaryFlags, bandRows). With more than one thread in the pool,
+	// the bands are labelled in parallel and joined along their seams.
+	template <typename LabelBand>
+	void labelInBands(LabelBand const& labelBand, AreaInformation& areaInformation, ThreadPool& threadPool) {
+		int const width = areaInformation.getWidth();
+		int const height = areaInformation.getHeight();
+		BitMask& boundaryFlags = areaInformation.prepareBoundaryFlags();
+		int const bandCount = std::max(1, std::min(threadPool.getThreadCount(), height));
+		if (bandCount == 1) {
+			BandRows bandRows;
+			labelBand(0, areaInformation, boundaryFlags, bandRows);
+			return;
+		}
+
+		// Every band gets its own label range, which is shifted into place once all bands are done
+		std::vector<int> bandFirstRows;
+		std::vector<AreaInformation> bands;
+		std::vector<BandRows> bandRows(bandCount);
+		bands.reserve(bandCount);
+		for (int i = 0; i < bandCount; ++i) {
+			int const firstRow = static_cast<int>((static_cast<std::int64_t>(height) * i) / bandCount);
+			int const lastRow = static_cast<int>((static_cast<std::int64_t>(height) * (i + 1)) / bandCount);
+			bandFirstRows.push_back(firstRow);
+			bands.emplace_back(width, lastRow - firstRow);
+		}
+
+		std::vector<long long> bandTimings(bandCount, 0);
+		ThreadPool::TaskGroup bandTasks;
+		for (int i = 0; i < bandCount; ++i) {
+			threadPool.run(bandTasks, [&, i]() {
+				auto const timeBandStart = std::chrono::steady_clock::now();
+				labelBand(bandFirstRows[i], bands[i], boundaryFlags, bandRows[i]);
+				auto const timeBandEnd = std::chrono::steady_clock::now();
+				bandTimings[i] = std::chrono::duration_cast<std::chrono::milliseconds>(timeBandEnd - timeBandStart).count();
+			});
+		}
+		threadPool.wait(bandTasks);
+		for (int i = 0; i < bandCount; ++i) {
+			logStream(LogLevel::Normal) << "Timing - Labelling band " << i << " (rows " << bandFirstRows[i] << " to " << (bandFirstRows[i] + bands[i].getHeight() - 1) << ", " << bands[i].getAreaCount() << " areas) took " << bandTimings[i] << "ms." << std::endl;
+		}
+
+		auto const timeSeamStart = std::chrono::steady_clock::now();
+		std::vector<int> areaOffsets;
+		areaOffsets.reserve(bandCount);
+		for (int i = 0; i < bandCount; ++i) {
+			areaOffsets.push_back(areaInformation.appendAreasOf(bands[i]));
+		}
+		ThreadPool::TaskGroup copyTasks;
+		for (int i = 0; i < bandCount; ++i) {
+			threadPool.run(copyTasks, [&, i]() {
+				areaInformation.copyLabelsOf(bands[i], bandFirstRows[i], areaOffsets[i]);
+			});
+		}
+		threadPool.wait(copyTasks);
+		for (int i = 1; i < bandCount; ++i) {
+			mergeSeam(bandRows[i - 1].last.data(), bandRows[i].first.data(), bandFirstRows[i], areaInformation, boundaryFlags);
+		}
+		auto const timeSeamEnd = std::chrono::steady_clock::now();
+		logStream(LogLevel::Normal) << "Timing - Joining " << bandCount << " bands along their seams took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeSeamEnd - timeSeamStart).count() << "ms." << std::endl;
+	}
+}
+
+void labelAreasByPixel(BitMask const& imageBw, int firstRow, AreaInformation& areaInformation, BitMask& boundaryFlags) {
+	int const width = areaInformation.getWidth();
+	int const height = areaInformation.getHeight();
+	for (int w = 0; w < width; ++w) {
+		for (int h = 0; h < height; ++h) {
+			// Always look left and up
+			bool const pixel = imageBw.get(w, firstRow + h);
+			bool const hasLeftArea = (w > 0) && (imageBw.get(w - 1, firstRow + h) == pixel);
+			bool const hasTopArea = (h > 0) && (imageBw.get(w, firstRow + h - 1) == pixel);
+			if (hasLeftArea && hasTopArea) {
+				int const topArea = areaInformation.getArea(w, h - 1);
+				int const leftArea = areaInformation.getArea(w - 1, h);
+				if (topArea == leftArea) {
+					areaInformation.setArea(w, h, leftArea);
+				} else {
+					// Merge
+					areaInformation.setArea(w, h, areaInformation.mergeAreas(topArea, leftArea));
+				}
+			} else if (hasLeftArea) {
+				int const leftArea = areaInformation.getArea(w - 1, h);
+				areaInformation.setArea(w, h, leftArea);
+			} else if (hasTopArea) {
+				int const topArea = areaInformation.getArea(w, h - 1);
+				areaInformation.setArea(w, h, topArea);
+			} else {
+				areaInformation.setArea(w, h, areaInformation.addArea());
+			}
+		}
+	}
+
+	if (width > 0) {
+		for (int h = 0; h < height; ++h) {
+			flagBoundaryPixels(imageBw.getRow(firstRow + h), (h > 0) ? imageBw.getRow(firstRow + h - 1) : nullptr, width, boundaryFlags.getRow(firstRow + h), (h > 0) ? boundaryFlags.getRow(firstRow + h - 1) : nullptr);
+		}
+	}
+}
+
+void labelAreasByRuns(BitMask const& imageBw, int firstRow, AreaInformation& areaInformation, BitMask& boundaryFlags) {
+	MaskRows rows(imageBw);
+	BandRows bandRows;
+	labelRowsByRuns(rows, firstRow, areaInformation, boundaryFlags, bandRows);
+}
+
+void labelAreas(LabellerType labellerType, BitMask const& imageBw, AreaInformation& areaInformation, ThreadPool& threadPool) {
+	labelInBands([&](int firstRow, AreaInformation& band, BitMask& boundaryFlags, BandRows& bandRows) {
+		labelBand(labellerType, imageBw, firstRow, band, boundaryFlags, bandRows);
+	}, areaInformation, threadPool);
+}
+
+void thresholdAndLabelAreas(ImageView const& image, int colourThreshold, BitMask* imageBw, AreaInformation& areaInformation, ThreadPool& threadPool) {
+	labelInBands([&](int firstRow, AreaInformation& band, BitMask& boundaryFlags, BandRows& bandRows) {
+		// Every band thresholds its own rows, into its own pair of row buffers without a mask
+		ThresholdedRows rows(image, colourThreshold, imageBw);
+		labelRowsByRuns(rows, firstRow, band, boundaryFlags, bandRows);
+	}, areaInformation, threadPool);
+}
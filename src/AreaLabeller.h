@@ -0,0 +1,51 @@
+#ifndef EDGEFINDER_AREALABELLER_H_
+#define EDGEFINDER_AREALABELLER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "AreaInformation.h"
+#include "BitMask.h"
+#include "ImageView.h"
+#include "ThreadPool.h"
+
+enum class LabellerType {
+	Pixel,
+	Runs
+};
+
+// Maximal run [begin, end) of equally coloured pixels in a row, with the area it was labelled with.
+struct Run {
+	int begin;
+	int end;
+	bool colour;
+	int area;
+};
+
+// Splits row y of the image into its runs (area -1), skipping whole words without a colour change.
+void extractRuns(BitMask const& imageBw, int y, std::vector<Run>& runs);
+
+// Same for a row of width pixels packed like the rows of a BitMask.
+void extractRuns(std::uint64_t const* row, int width, std::vector<Run>& runs);
+
+// Sets the flags of the pixels in row that differ from their left or right neighbour. With rowAbove, pixels differing from the one above
+// are flagged in both flags and flagsAbove. Every boundary between two areas, however they are merged later, runs along flagged pixels.
+void flagBoundaryPixels(std::uint64_t const* row, std::uint64_t const* rowAbove, int width, std::uint64_t* flags, std::uint64_t* flagsAbove);
+
+// Labels every pixel of the black/white image with a provisional area, looking left and up per pixel.
+// Covers the rows [firstRow, firstRow + areaInformation.getHeight()) of the image, and flags their boundary pixels in the same rows of boundaryFlags.
+void labelAreasByPixel(BitMask const& imageBw, int firstRow, AreaInformation& areaInformation, BitMask& boundaryFlags);
+
+// Labels whole runs of equally coloured pixels per row against the overlapping runs of the previous row.
+// Covers the rows [firstRow, firstRow + areaInformation.getHeight()) of the image, and flags their boundary pixels in the same rows of boundaryFlags.
+void labelAreasByRuns(BitMask const& imageBw, int firstRow, AreaInformation& areaInformation, BitMask& boundaryFlags);
+
+// Labels the whole image and fills the boundary flags of areaInformation.
+// With more than one thread in the pool, horizontal bands are labelled in parallel and joined along their seams.
+void labelAreas(LabellerType labellerType, BitMask const& imageBw, AreaInformation& areaInformation, ThreadPool& threadPool);
+
+// Same as thresholdImage() followed by labelAreas() with the runs labeller, but in a single pass that thresholds every row of the image
+// right before labelling it. Only the current row and the one above exist, unless imageBw is given, which then receives every row as well.
+void thresholdAndLabelAreas(ImageView const& image, int colourThreshold, BitMask* imageBw, AreaInformation& areaInformation, ThreadPool& threadPool);
+
+#endif
@@ -0,0 +1,43 @@
+#include "AreaUnionFind.h"
+
+#include <utility>
+
+AreaUnionFind::AreaUnionFind() : m_parents(), m_setSizes() {
+	//
+}
+
+int AreaUnionFind::addArea() {
+	int const newArea = static_cast<int>(m_parents.size());
+	m_parents.push_back(newArea);
+	m_setSizes.push_back(1);
+	return newArea;
+}
+
+int AreaUnionFind::unite(int areaA, int areaB) {
+	int rootA = find(areaA);
+	int rootB = find(areaB);
+	if (rootA == rootB) {
+		return rootA;
+	}
+
+	if (m_setSizes[rootA] < m_setSizes[rootB]) {
+		std::swap(rootA, rootB);
+	}
+	m_parents[rootB] = rootA;
+	m_setSizes[rootA] += m_setSizes[rootB];
+	return rootA;
+}
+
+int AreaUnionFind::getAreaCount() const {
+	return static_cast<int>(m_parents.size());
+}
+
+void AreaUnionFind::reserve(std::size_t areaCount) {
+	m_parents.reserve(areaCount);
+	m_setSizes.reserve(areaCount);
+}
+
+void AreaUnionFind::clear() {
+	m_parents.clear();
+	m_setSizes.clear();
+}
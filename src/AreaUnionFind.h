@@ -0,0 +1,41 @@
+#ifndef EDGEFINDER_AREAUNIONFIND_H_
+#define EDGEFINDER_AREAUNIONFIND_H_
+
+#include <cstdint>
+#include <vector>
+
+/*
+	Disjoint-set forest over area ids, stored in two contiguous arrays.
+	Uses path halving on lookup and union by size, so both are amortized near-constant.
+*/
+class AreaUnionFind {
+public:
+	AreaUnionFind();
+
+	int addArea();
+
+	// Returns the representative (root) area of the set containing area.
+	inline int find(int area) const {
+		while (m_parents[area] != area) {
+			m_parents[area] = m_parents[m_parents[area]];
+			area = m_parents[area];
+		}
+		return area;
+	}
+
+	// Joins the sets of both areas and returns the surviving root.
+	int unite(int areaA, int areaB);
+
+	int getAreaCount() const;
+
+	void reserve(std::size_t areaCount);
+
+	// Forgets all areas, keeping the allocated memory.
+	void clear();
+private:
+	// Mutable, as find() compresses paths even on const access.
+	mutable std::vector<int> m_parents;
+	std::vector<int> m_setSizes;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#include "BitMask.h"
+
+BitMask::BitMask(int width, int height) : m_w(width), m_h(height), m_wordsPerRow((width + 63) / 64), m_words(static_cast<std::size_t>(m_wordsPerRow) * height, 0) {
+	//
+}
+
+int BitMask::getWidth() const {
+	return m_w;
+}
+
+int BitMask::getHeight() const {
+	return m_h;
+}
+
+int BitMask::getWordsPerRow() const {
+	return m_wordsPerRow;
+}
+
+std::uint64_t BitMask::getLastWordMask() const {
+	int const usedBits = m_w & 63;
+	return (usedBits == 0) ? ~std::uint64_t(0) : ((std::uint64_t(1) << usedBits) - 1);
+}
@@ -0,0 +1,66 @@
+#ifndef EDGEFINDER_BITMASK_H_
+#define EDGEFINDER_BITMASK_H_
+
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+	Black/white image with one bit per pixel, stored row by row in 64bit words.
+	Pixel x of a row is bit (x % 64) of word (x / 64), unused bits at the end of a row are always zero.
+*/
+class BitMask {
+public:
+	BitMask(int width, int height);
+
+	inline bool get(int x, int y) const {
+		return (m_words[wordIndex(x, y)] >> (x & 63)) & 1u;
+	}
+
+	inline void set(int x, int y, bool value) {
+		std::uint64_t const bit = std::uint64_t(1) << (x & 63);
+		std::uint64_t& word = m_words[wordIndex(x, y)];
+		word = value ? (word | bit) : (word & ~bit);
+	}
+
+	inline std::uint64_t const* getRow(int y) const {
+		return m_words.data() + static_cast<std::size_t>(y) * m_wordsPerRow;
+	}
+
+	inline std::uint64_t* getRow(int y) {
+		return m_words.data() + static_cast<std::size_t>(y) * m_wordsPerRow;
+	}
+
+	int getWidth() const;
+
+	int getHeight() const;
+
+	int getWordsPerRow() const;
+
+	// Mask of the valid bits in the last word of every row.
+	std::uint64_t getLastWordMask() const;
+
+	static inline int countTrailingZeros(std::uint64_t word) {
+#ifdef _MSC_VER
+		unsigned long index = 0;
+		_BitScanForward64(&index, word);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctzll(word);
+#endif
+	}
+private:
+	int m_w;
+	int m_h;
+	int m_wordsPerRow;
+	std::vector<std::uint64_t> m_words;
+
+	inline std::size_t wordIndex(int x, int y) const {
+		return static_cast<std::size_t>(y) * m_wordsPerRow + (x >> 6);
+	}
+};
+
+#endif
@@ -0,0 +1,308 @@
+#include "ContourTracer.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+namespace {
+	// Sides of a pixel in clockwise order. The crack on a side is walked clockwise around the pixel, keeping the area on the right.
+	enum Side : int {
+		Top = 0,
+		Right = 1,
+		Bottom = 2,
+		Left = 3
+	};
+
+	// Offset to the pixel across each side
+	std::array<int, 4> const sideDx = { 0, 1, 0, -1 };
+	std::array<int, 4> const sideDy = { -1, 0, 1, 0 };
+
+	// Corner at which walking along each side starts
+	std::array<int, 4> const startCornerDx = { 0, 1, 1, 0 };
+	std::array<int, 4> const startCornerDy = { 0, 0, 1, 1 };
+
+	struct CrackState {
+		int x;
+		int y;
+		int side;
+
+		bool operator==(CrackState const& other) const {
+			return (x == other.x) && (y == other.y) && (side == other.side);
+		}
+	};
+
+	inline Point startCorner(CrackState const& state) {
+		return std::make_pair(static_cast<PointType>(state.x + startCornerDx[state.side]), static_cast<PointType>(state.y + startCornerDy[state.side]));
+	}
+
+	inline Point endCorner(CrackState const& state) {
+		int const nextSide = (state.side + 1) & 3;
+		return std::make_pair(static_cast<PointType>(state.x + startCornerDx[nextSide]), static_cast<PointType>(state.y + startCornerDy[nextSide]));
+	}
+
+	/*
+		Follows outlines over a source of cracks, which tells whether a crack exists on a side of a pixel, the area of a pixel
+		on a crack and keeps track of the traced cracks. Only needs cracks, so it works on full labels as well as on a crack list.
+	*/
+	template <typename CrackSource>
+	class Tracer {
+	public:
+		Tracer(CrackSource& cracks, int width, int height) : m_cracks(cracks), m_w(width), m_h(height) {
+			//
+		}
+
+		inline bool isInside(int x, int y) const {
+			return (x >= 0) && (y >= 0) && (x < m_w) && (y < m_h);
+		}
+
+		// Follows the outline to the next crack, returns false if it ends at the image border
+		bool step(CrackState& state) const {
+			int const forwardSide = (state.side + 1) & 3;
+			if (m_cracks.isCrack(state.x, state.y, forwardSide)) {
+				// Turn right, around our own pixel
+				state.side = forwardSide;
+				return true;
+			}
+
+			int const aheadX = state.x + sideDx[forwardSide];
+			int const aheadY = state.y + sideDy[forwardSide];
+			if (!isInside(aheadX, aheadY)) {
+				return false;
+			}
+			if (m_cracks.isCrack(aheadX, aheadY, state.side)) {
+				// Straight on, along the pixel ahead
+				state.x = aheadX;
+				state.y = aheadY;
+			} else {
+				// Turn left, onto the diagonal pixel (it has our area, as the pixel across the crack does not)
+				state.x = aheadX + sideDx[state.side];
+				state.y = aheadY + sideDy[state.side];
+				state.side = (state.side + 3) & 3;
+			}
+			return true;
+		}
+
+		std::vector<Point> trace(CrackState const& start) {
+			std::vector<Point> line;
+			line.push_back(startCorner(start));
+
+			CrackState state = start;
+			m_cracks.markVisited(state);
+			while (true) {
+				int const previousSide = state.side;
+				Point const corner = endCorner(state);
+				if (!step(state)) {
+					// Open outline, ended at the image border
+					line.push_back(corner);
+					break;
+				}
+				if (state.side != previousSide) {
+					line.push_back(corner);
+				}
+				if (state == start) {
+					// Closed outline
+					if (line.back() != line.front()) {
+						line.push_back(line.front());
+					}
+					break;
+				}
+				assert(!m_cracks.isVisited(state) && "Internal Error: Contour ran into an already traced crack!");
+				m_cracks.markVisited(state);
+			}
+			return line;
+		}
+
+		void traceIfUnvisited(CrackState const& start, std::vector<std::vector<std::vector<Point>>>& result) {
+			if (m_cracks.isCrack(start.x, start.y, start.side) && !m_cracks.isVisited(start)) {
+				result[m_cracks.getArea(start)].push_back(trace(start));
+			}
+		}
+
+		// Outlines that start at the image border go first, as they can not be entered in the middle
+		void traceOpenOutlines(std::vector<std::vector<std::vector<Point>>>& result) {
+			for (int x = 0; x < m_w; ++x) {
+				traceIfUnvisited({ x, 0, Right }, result);
+				traceIfUnvisited({ x, m_h - 1, Left }, result);
+			}
+			for (int y = 0; y < m_h; ++y) {
+				traceIfUnvisited({ 0, y, Top }, result);
+				traceIfUnvisited({ m_w - 1, y, Bottom }, result);
+			}
+		}
+	private:
+		CrackSource& m_cracks;
+		int const m_w;
+		int const m_h;
+	};
+
+	// Cracks derived from packed labels of either width, a crack exists on a side if the pixel across it is inside the image and belongs to another area
+	template <typename Label>
+	class LabelCracks {
+	public:
+		LabelCracks(Label const* labels, int width, int height) : m_labels(labels), m_w(width), m_h(height), m_visitedSides(static_cast<std::size_t>(m_w) * m_h, 0) {
+			//
+		}
+
+		inline int label(int x, int y) const {
+			return m_labels[AreaInformation::posToVec(x, y, m_w)];
+		}
+
+		inline bool isCrack(int x, int y, int side) const {
+			int const otherX = x + sideDx[side];
+			int const otherY = y + sideDy[side];
+			return (otherX >= 0) && (otherY >= 0) && (otherX < m_w) && (otherY < m_h) && (label(otherX, otherY) != label(x, y));
+		}
+
+		inline int getArea(CrackState const& state) const {
+			return label(state.x, state.y);
+		}
+
+		inline bool isVisited(CrackState const& state) const {
+			return (m_visitedSides[AreaInformation::posToVec(state.x, state.y, m_w)] >> state.side) & 1u;
+		}
+
+		inline void markVisited(CrackState const& state) {
+			m_visitedSides[AreaInformation::posToVec(state.x, state.y, m_w)] |= static_cast<std::uint8_t>(1u << state.side);
+		}
+	private:
+		Label const* const m_labels;
+		int const m_w;
+		int const m_h;
+
+		// Bit s is set once the crack on side s of a pixel was traced
+		std::vector<std::uint8_t> m_visitedSides;
+	};
+
+	// Cracks given as a sorted list of keys, looked up by binary search
+	class ListedCracks {
+	public:
+		ListedCracks(std::vector<std::uint64_t> const& crackKeys, std::vector<int> const& crackAreas) : m_crackKeys(crackKeys), m_crackAreas(crackAreas), m_visited(crackKeys.size(), 0) {
+			//
+		}
+
+		inline bool isCrack(int x, int y, int side) const {
+			return (x >= 0) && (y >= 0) && (find(x, y, side) != npos);
+		}
+
+		inline int getArea(CrackState const& state) const {
+			return m_crackAreas[find(state.x, state.y, state.side)];
+		}
+
+		inline bool isVisited(CrackState const& state) const {
+			return m_visited[find(state.x, state.y, state.side)] != 0;
+		}
+
+		inline void markVisited(CrackState const& state) {
+			m_visited[find(state.x, state.y, state.side)] = 1;
+		}
+
+		inline bool isVisited(std::size_t index) const {
+			return m_visited[index] != 0;
+		}
+
+		static inline CrackState toState(std::uint64_t key) {
+			return { static_cast<int>((key >> 2) & 0xFFFFFFFFu), static_cast<int>(key >> 34), static_cast<int>(key & 3u) };
+		}
+	private:
+		static std::size_t const npos = static_cast<std::size_t>(-1);
+
+		std::vector<std::uint64_t> const& m_crackKeys;
+		std::vector<int> const& m_crackAreas;
+		std::vector<std::uint8_t> m_visited;
+
+		inline std::size_t find(int x, int y, int side) const {
+			std::uint64_t const key = makeCrackKey(x, y, static_cast<PixelSide>(side));
+			auto const it = std::lower_bound(m_crackKeys.cbegin(), m_crackKeys.cend(), key);
+			return ((it != m_crackKeys.cend()) && (*it == key)) ? static_cast<std::size_t>(it - m_crackKeys.cbegin()) : npos;
+		}
+	};
+
+	template <typename Label>
+	void traceContoursOfLabels(Label const* labels, BitMask const* boundaryFlags, int width, int height, std::vector<std::vector<std::vector<Point>>>& result) {
+		LabelCracks<Label> cracks(labels, width, height);
+		Tracer<LabelCracks<Label>> tracer(cracks, width, height);
+		tracer.traceOpenOutlines(result);
+
+		// Everything left over is a closed outline, most pixels are inside an area and are skipped after comparing labels
+		auto const traceAround = [&](int x, int y) {
+			Label const* row = labels + AreaInformation::posToVec(0, y, width);
+			Label const* rowAbove = (y > 0) ? (row - width) : row;
+			Label const* rowBelow = (y + 1 < height) ? (row + width) : row;
+			int const area = row[x];
+			bool const isBoundary = (rowAbove[x] != area) || (rowBelow[x] != area) || ((x > 0) && (row[x - 1] != area)) || ((x + 1 < width) && (row[x + 1] != area));
+			if (isBoundary) {
+				for (int side = Top; side <= Left; ++side) {
+					tracer.traceIfUnvisited({ x, y, side }, result);
+				}
+			}
+		};
+		for (int y = 0; y < height; ++y) {
+			if (boundaryFlags != nullptr) {
+				// Pixels without a flag can not be on an outline, whole words of them are skipped in the same row-major order
+				std::uint64_t const* flags = boundaryFlags->getRow(y);
+				for (int i = 0; i < boundaryFlags->getWordsPerRow(); ++i) {
+					for (std::uint64_t word = flags[i]; word != 0; word &= word - 1) {
+						traceAround(i * 64 + BitMask::countTrailingZeros(word), y);
+					}
+				}
+			} else {
+				for (int x = 0; x < width; ++x) {
+					traceAround(x, y);
+				}
+			}
+		}
+	}
+}
+
+std::vector<std::vector<std::vector<Point>>> traceContoursPerArea(AreaInformation const& areaInformation) {
+	int const width = areaInformation.getWidth();
+	int const height = areaInformation.getHeight();
+	std::vector<std::vector<std::vector<Point>>> result(areaInformation.getAreaCount());
+	if ((width <= 0) || (height <= 0)) {
+		return result;
+	}
+
+	BitMask const* const boundaryFlags = areaInformation.hasBoundaryFlags() ? &areaInformation.getBoundaryFlags() : nullptr;
+	if (areaInformation.hasNarrowLabels()) {
+		traceContoursOfLabels(areaInformation.getNarrowAreaRow(0), boundaryFlags, width, height, result);
+	} else {
+		traceContoursOfLabels(areaInformation.getAreaRow(0), boundaryFlags, width, height, result);
+	}
+	return result;
+}
+
+std::vector<std::vector<std::vector<Point>>> traceContoursOfCracks(int width, int height, int areaCount, std::vector<std::uint64_t> const& crackKeys, std::vector<int> const& crackAreas) {
+	assert(std::is_sorted(crackKeys.cbegin(), crackKeys.cend()) && "Internal Error: Crack keys are not sorted!");
+	std::vector<std::vector<std::vector<Point>>> result(areaCount);
+	if ((width <= 0) || (height <= 0)) {
+		return result;
+	}
+
+	ListedCracks cracks(crackKeys, crackAreas);
+	Tracer<ListedCracks> tracer(cracks, width, height);
+	tracer.traceOpenOutlines(result);
+
+	// The keys are in the order the label scan above visits pixels and sides, so closed outlines start at the same crack
+	for (std::size_t i = 0; i < crackKeys.size(); ++i) {
+		if (!cracks.isVisited(i)) {
+			result[crackAreas[i]].push_back(tracer.trace(ListedCracks::toState(crackKeys[i])));
+		}
+	}
+	return result;
+}
+
+std::vector<std::vector<std::vector<Point>>> formLinesPerArea(LineFormerType lineFormerType, AreaInformation const& areaInformation) {
+	std::size_t maxStackSize = 0;
+	return formLinesPerArea(lineFormerType, areaInformation, maxStackSize);
+}
+
+std::vector<std::vector<std::vector<Point>>> formLinesPerArea(LineFormerType lineFormerType, AreaInformation const& areaInformation, std::size_t& maxStackSize) {
+	maxStackSize = 0;
+	switch (lineFormerType) {
+		case LineFormerType::Contour:
+			return traceContoursPerArea(areaInformation);
+		case LineFormerType::PointSearch:
+		default:
+			return areaInformation.getListOfLinesPerArea(maxStackSize);
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef EDGEFINDER_CONTOURTRACER_H_
+#define EDGEFINDER_CONTOURTRACER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "AreaInformation.h"
+#include "Point.h"
+
+enum class LineFormerType {
+	PointSearch,
+	Contour
+};
+
+/*
+	Traces the outlines between areas along the pixel edges ("cracks") in one linear pass over the labels.
+	Points are pixel corners, so a pixel (x, y) spans [x, x + 1] x [y, y + 1], and only corners where the outline turns are emitted.
+	Outlines enclosing an area are closed (first point == last point), outlines ending at the image border are open.
+	Requires packed areas.
+*/
+std::vector<std::vector<std::vector<Point>>> traceContoursPerArea(AreaInformation const& areaInformation);
+
+// Sides of a pixel in clockwise order, starting at the top.
+enum class PixelSide : int {
+	Top = 0,
+	Right = 1,
+	Bottom = 2,
+	Left = 3
+};
+
+// Orders cracks row-major by pixel, then by side. A crack belongs to the pixel whose area lies on its side.
+inline std::uint64_t makeCrackKey(int x, int y, PixelSide side) {
+	return (static_cast<std::uint64_t>(y) << 34) | (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 2) | static_cast<std::uint64_t>(side);
+}
+
+// Same outlines in the same order as traceContoursPerArea(), but from the sorted keys of all cracks between different areas
+// and the area of each. Used where the full labels never exist at once.
+std::vector<std::vector<std::vector<Point>>> traceContoursOfCracks(int width, int height, int areaCount, std::vector<std::uint64_t> const& crackKeys, std::vector<int> const& crackAreas);
+
+std::vector<std::vector<std::vector<Point>>> formLinesPerArea(LineFormerType lineFormerType, AreaInformation const& areaInformation);
+
+// Same, also reporting the deepest stack of the point search. The contour tracer needs none and reports 0.
+std::vector<std::vector<std::vector<Point>>> formLinesPerArea(LineFormerType lineFormerType, AreaInformation const& areaInformation, std::size_t& maxStackSize);
+
+#endif
@@ -0,0 +1,647 @@
+#include "EdgeFinder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "LineSimplifier.h"
+#include "Log.h"
+#include "RegionAdjacencyGraph.h"
+#include "StageCache.h"
+#include "StripLabeller.h"
+#include "Threshold.h"
+
+namespace {
+	// Averages every block of scale x scale pixels into one opaque pixel, the blocks at the right and bottom border may be smaller
+	std::vector<std::uint32_t> downsampleImage(ImageView const& image, int scale, ThreadPool& threadPool, int& width, int& height) {
+		width = (image.width + scale - 1) / scale;
+		height = (image.height + scale - 1) / scale;
+		std::vector<std::uint32_t> pixels(static_cast<std::size_t>(width) * height);
+
+		auto const downsampleRows = [&image, scale, width, &pixels](int firstRow, int lastRow) {
+			std::vector<std::uint32_t> sums(static_cast<std::size_t>(width) * 3);
+			std::vector<std::uint32_t> rgbLine(image.width);
+			for (int y = firstRow; y < lastRow; ++y) {
+				std::fill(sums.begin(), sums.end(), 0u);
+				int const rows = std::min(scale, image.height - y * scale);
+				for (int row = 0; row < rows; ++row) {
+					std::uint32_t const* const line = getRgb32Row(image, y * scale + row, rgbLine.data());
+					for (int x = 0; x < width; ++x) {
+						std::uint32_t* const sum = sums.data() + static_cast<std::size_t>(x) * 3;
+						int const lastColumn = std::min(image.width, (x + 1) * scale);
+						for (int column = x * scale; column < lastColumn; ++column) {
+							std::uint32_t const pixel = line[column];
+							sum[0] += (pixel >> 16) & 0xFFu;
+							sum[1] += (pixel >> 8) & 0xFFu;
+							sum[2] += pixel & 0xFFu;
+						}
+					}
+				}
+				std::uint32_t* const outLine = pixels.data() + static_cast<std::size_t>(y) * width;
+				for (int x = 0; x < width; ++x) {
+					std::uint32_t const* const sum = sums.data() + static_cast<std::size_t>(x) * 3;
+					std::uint32_t const count = static_cast<std::uint32_t>(rows * (std::min(image.width, (x + 1) * scale) - x * scale));
+					outLine[x] = 0xFF000000u | ((sum[0] / count) << 16) | ((sum[1] / count) << 8) | (sum[2] / count);
+				}
+			}
+		};
+
+		// A few tasks per thread, so uneven rows still balance
+		int const rowsPerTask = std::max(1, height / (threadPool.getThreadCount() * 4));
+		ThreadPool::TaskGroup taskGroup;
+		for (int firstRow = 0; firstRow < height; firstRow += rowsPerTask) {
+			int const lastRow = std::min(height, firstRow + rowsPerTask);
+			threadPool.run(taskGroup, [&downsampleRows, firstRow, lastRow]() { downsampleRows(firstRow, lastRow); });
+		}
+		threadPool.wait(taskGroup);
+		return pixels;
+	}
+
+	// Boundary pixels as the point search collects them: both pixels of every differing pair of 4-neighbours. The border of the image is no outline.
+	bool isOutlinePixel(BitMask const& mask, int x, int y) {
+		bool const value = mask.get(x, y);
+		return ((x > 0) && (mask.get(x - 1, y) != value)) || ((x + 1 < mask.getWidth()) && (mask.get(x + 1, y) != value))
+			|| ((y > 0) && (mask.get(x, y - 1) != value)) || ((y + 1 < mask.getHeight()) && (mask.get(x, y + 1) != value));
+	}
+
+	// Pixel corners as the contour tracer walks them: corners between differing pixels. Only the pixels in the image count,
+	// so on its border the two pixels along it are compared and the corners of the image never are outline corners.
+	bool isOutlineCorner(BitMask const& mask, int x, int y) {
+		int const left = std::max(0, x - 1);
+		int const right = std::min(mask.getWidth() - 1, x);
+		int const top = std::max(0, y - 1);
+		int const bottom = std::min(mask.getHeight() - 1, y);
+		bool const value = mask.get(left, top);
+		return (mask.get(right, top) != value) || (mask.get(left, bottom) != value) || (mask.get(right, bottom) != value);
+	}
+
+	// Moves every point onto the nearest outline of the mask within radius, points without one nearby stay where they are
+	void refineLine(BitMask const& mask, bool isTracingCorners, int radius, std::vector<Point>& line) {
+		int const maxX = isTracingCorners ? mask.getWidth() : (mask.getWidth() - 1);
+		int const maxY = isTracingCorners ? mask.getHeight() : (mask.getHeight() - 1);
+		for (auto& point : line) {
+			int const centerX = static_cast<int>(std::lround(point.first));
+			int const centerY = static_cast<int>(std::lround(point.second));
+			int bestDistance = std::numeric_limits<int>::max();
+			for (int y = std::max(0, centerY - radius); y <= std::min(maxY, centerY + radius); ++y) {
+				for (int x = std::max(0, centerX - radius); x <= std::min(maxX, centerX + radius); ++x) {
+					int const distance = (x - centerX) * (x - centerX) + (y - centerY) * (y - centerY);
+					if ((distance < bestDistance) && (isTracingCorners ? isOutlineCorner(mask, x, y) : isOutlinePixel(mask, x, y))) {
+						bestDistance = distance;
+						point = std::make_pair(static_cast<PointType>(x), static_cast<PointType>(y));
+					}
+				}
+			}
+		}
+		// Neighbours that landed on the same spot are kept once
+		line.erase(std::unique(line.begin(), line.end()), line.end());
+	}
+}
+
+QImage toSupportedFormat(QImage const& image) {
+	switch (image.format()) {
+		case QImage::Format_RGB32:
+		case QImage::Format_ARGB32:
+		case QImage::Format_RGB888:
+		case QImage::Format_Grayscale8:
+		case QImage::Format_Indexed8:
+			return image;
+		default:
+			// The pipeline reads unpremultiplied 0xAARRGGBB pixels of everything else
+			return image.convertToFormat(QImage::Format_ARGB32);
+	}
+}
+
+ImageView makeImageView(QImage const& image) {
+	ImageView view = { image.constBits(), image.width(), image.height(), static_cast<std::size_t>(image.bytesPerLine()), PixelFormat::Rgb32, {} };
+	switch (image.format()) {
+		case QImage::Format_RGB888:
+			view.format = PixelFormat::Rgb888;
+			break;
+		case QImage::Format_Grayscale8:
+			view.format = PixelFormat::Grayscale8;
+			break;
+		case QImage::Format_Indexed8: {
+			auto const colorTable = image.colorTable();
+			view.format = PixelFormat::Indexed8;
+			view.palette.assign(colorTable.begin(), colorTable.end());
+			break;
+		}
+		default:
+			break;
+	}
+	return view;
+}
+
+EdgeFinder::EdgeFinder(EdgeFinderOptions const& options, ThreadPool& threadPool) : m_options(options), m_threadPool(threadPool), m_profiler(nullptr), m_cache(nullptr), m_blackWhiteMaskCallback(), m_areasCallback(), m_imageBw(0, 0), m_areaInformation(0, 0) {
+	//
+}
+
+EdgeFinderOptions const& EdgeFinder::getOptions() const {
+	return m_options;
+}
+
+void EdgeFinder::setOptions(EdgeFinderOptions const& options) {
+	m_options = options;
+}
+
+void EdgeFinder::setProfiler(StageProfiler* profiler) {
+	m_profiler = profiler;
+}
+
+void EdgeFinder::setCache(StageCache* cache) {
+	m_cache = cache;
+}
+
+void EdgeFinder::setBlackWhiteMaskCallback(BlackWhiteMaskCallback callback) {
+	m_blackWhiteMaskCallback = std::move(callback);
+}
+
+void EdgeFinder::setAreasCallback(AreasCallback callback) {
+	m_areasCallback = std::move(callback);
+}
+
+EdgeFinderResult EdgeFinder::process(ImageView const& image) {
+	StageProfiler localProfiler;
+	StageProfiler& profiler = (m_profiler != nullptr) ? *m_profiler : localProfiler;
+	EdgeFinderResult result;
+	result.width = image.width;
+	result.height = image.height;
+	AreaInformation areas(0, 0);
+	std::vector<std::vector<std::vector<Point>>> listOfLinesPerArea;
+	ImageView const content = runCropping(image, profiler, result);
+
+	// With a cache, the pipeline continues behind the deepest stage stored for this image and these options
+	QByteArray imageHash;
+	bool hasCachedMask = false;
+	bool hasCachedAreas = false;
+	bool hasCachedLines = false;
+	if (m_cache != nullptr) {
+		profiler.beginStage("cacheLoading");
+		imageHash = StageCache::hashImage(image);
+		hasCachedAreas = m_cache->loadAreas(imageHash, m_options.colourThreshold, m_options.areaSizeThreshold, areas, result.statistics);
+		// Areas of another crop were stored with cropping switched the other way
+		hasCachedAreas = hasCachedAreas && (areas.getWidth() == content.width) && (areas.getHeight() == content.height);
+		if (hasCachedAreas) {
+			hasCachedLines = m_cache->loadLines(imageHash, m_options.colourThreshold, m_options.areaSizeThreshold, m_options.lineFormerType, listOfLinesPerArea, result.statistics);
+		} else {
+			prepareBuffers(content.width, content.height, true);
+			hasCachedMask = m_cache->loadMask(imageHash, m_options.colourThreshold, m_imageBw);
+		}
+		char const* const cachedStage = hasCachedLines ? "lines" : (hasCachedAreas ? "areas" : (hasCachedMask ? "black and white mask" : "nothing"));
+		logStream(LogLevel::Normal) << "Timing - Hashing the image and loading the cached " << cachedStage << " took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+		profiler.addCounter("cachedStages", hasCachedLines ? 3 : (hasCachedAreas ? 2 : (hasCachedMask ? 1 : 0)));
+	}
+
+	if (!hasCachedAreas) {
+		if (hasCachedMask) {
+			if (m_blackWhiteMaskCallback) {
+				m_blackWhiteMaskCallback(m_imageBw, result.crop, m_options);
+			}
+			areas = runLabelling(profiler, result);
+		} else {
+			// The cache keeps the mask, so then it has to exist in full
+			areas = runThresholdAndLabelling(content, m_options, m_cache != nullptr, profiler, result);
+			if (m_cache != nullptr) {
+				profiler.beginStage("cacheStoring");
+				reportCacheStore("black and white mask", m_cache->storeMask(imageHash, m_options.colourThreshold, m_imageBw), profiler);
+			}
+		}
+		addCroppedPixels(areas, result.crop);
+		runSmallAreaMerging(areas, m_options.areaSizeThreshold, profiler, result);
+		if (m_cache != nullptr) {
+			profiler.beginStage("cacheStoring");
+			reportCacheStore("areas", m_cache->storeAreas(imageHash, m_options.colourThreshold, m_options.areaSizeThreshold, areas, result.statistics), profiler);
+		}
+	} else {
+		// The mask is cheaper to recompute than to keep in the cache next to the areas
+		if (m_blackWhiteMaskCallback) {
+			runThreshold(content, m_options.colourThreshold, profiler);
+			m_blackWhiteMaskCallback(m_imageBw, result.crop, m_options);
+		}
+		for (int i = 0; i < areas.getAreaCount(); ++i) {
+			result.areaSizes.push_back(areas.getAreaMemberCount(i));
+		}
+	}
+	if (m_areasCallback) {
+		m_areasCallback(areas, result.crop, m_options);
+	}
+
+	if (!hasCachedLines) {
+		listOfLinesPerArea = runLineForming(areas, profiler, result);
+		if (m_cache != nullptr) {
+			profiler.beginStage("cacheStoring");
+			reportCacheStore("lines", m_cache->storeLines(imageHash, m_options.colourThreshold, m_options.areaSizeThreshold, m_options.lineFormerType, listOfLinesPerArea, result.statistics), profiler);
+		}
+	}
+	std::vector<std::vector<Point> const*> const keptLines = runDeduplication(listOfLinesPerArea, profiler, result);
+	runRdp(keptLines, m_options.epsilon, profiler, result);
+	result.areas = std::move(areas);
+	return result;
+}
+
+void EdgeFinder::sweep(ImageView const& image, EdgeFinderSweep const& sweep, SweepCallback const& onResult) {
+	StageProfiler localProfiler;
+	StageProfiler& profiler = (m_profiler != nullptr) ? *m_profiler : localProfiler;
+	EdgeFinderOptions options = m_options;
+	EdgeFinderResult croppedResult;
+	croppedResult.width = image.width;
+	croppedResult.height = image.height;
+	ImageView const content = runCropping(image, profiler, croppedResult);
+
+	for (int const colourThreshold : sweep.colourThresholds) {
+		options.colourThreshold = colourThreshold;
+		EdgeFinderResult labelledResult = croppedResult;
+
+		AreaInformation connectedAreas = runThresholdAndLabelling(content, options, false, profiler, labelledResult);
+		addCroppedPixels(connectedAreas, labelledResult.crop);
+
+		for (int const areaSizeThreshold : sweep.areaSizeThresholds) {
+			options.areaSizeThreshold = areaSizeThreshold;
+			EdgeFinderResult mergedResult = labelledResult;
+
+			AreaInformation areas = connectedAreas;
+			runSmallAreaMerging(areas, areaSizeThreshold, profiler, mergedResult);
+			if (m_areasCallback) {
+				m_areasCallback(areas, mergedResult.crop, options);
+			}
+			auto const listOfLinesPerArea = runLineForming(areas, profiler, mergedResult);
+			std::vector<std::vector<Point> const*> const keptLines = runDeduplication(listOfLinesPerArea, profiler, mergedResult);
+
+			for (double const epsilon : sweep.epsilons) {
+				options.epsilon = epsilon;
+				EdgeFinderResult result = mergedResult;
+				runRdp(keptLines, epsilon, profiler, result);
+				onResult(options, result);
+			}
+		}
+	}
+}
+
+bool EdgeFinder::processInStrips(int width, int height, int stripHeight, StripReader const& readStrip, EdgeFinderResult& result) {
+	StageProfiler localProfiler;
+	StageProfiler& profiler = (m_profiler != nullptr) ? *m_profiler : localProfiler;
+	result = EdgeFinderResult();
+	result.width = width;
+	result.height = height;
+	result.crop = { 0, 0, width, height, width, height };
+
+	// Reading, thresholding and labelling alternate per strip, so they are one stage with the parts as counters
+	profiler.beginStage("strips");
+	std::chrono::steady_clock::duration readingTime(0);
+	std::chrono::steady_clock::duration thresholdingTime(0);
+	std::chrono::steady_clock::duration labellingTime(0);
+	StripLabeller stripLabeller(width, height);
+	BitMask strip(width, std::min(stripHeight, height));
+	int stripCount = 0;
+	std::string kernelName;
+	for (int firstRow = 0; firstRow < height; firstRow += stripHeight) {
+		int const rows = std::min(stripHeight, height - firstRow);
+
+		auto const timeReadingStart = std::chrono::steady_clock::now();
+		ImageView stripImage = { nullptr, width, rows, 0, PixelFormat::Rgb32, {} };
+		if (!readStrip(firstRow, rows, stripImage)) {
+			profiler.endStage();
+			return false;
+		}
+		auto const timeThresholdingStart = std::chrono::steady_clock::now();
+		if (strip.getHeight() != rows) {
+			strip = BitMask(width, rows);
+		}
+		thresholdImage(stripImage, m_options.colourThreshold, strip);
+		if (stripCount == 0) {
+			kernelName = ImageThresholder(stripImage, m_options.colourThreshold).getKernelName();
+		}
+		auto const timeLabellingStart = std::chrono::steady_clock::now();
+		stripLabeller.labelStrip(strip, firstRow);
+		auto const timeLabellingEnd = std::chrono::steady_clock::now();
+
+		readingTime += timeThresholdingStart - timeReadingStart;
+		thresholdingTime += timeLabellingStart - timeThresholdingStart;
+		labellingTime += timeLabellingEnd - timeLabellingStart;
+		++stripCount;
+	}
+	profiler.endStage();
+	profiler.addCounter("strips", stripCount);
+	profiler.addCounter("readingMicroseconds", std::chrono::duration_cast<std::chrono::microseconds>(readingTime).count());
+	profiler.addCounter("thresholdingMicroseconds", std::chrono::duration_cast<std::chrono::microseconds>(thresholdingTime).count());
+	profiler.addCounter("labellingMicroseconds", std::chrono::duration_cast<std::chrono::microseconds>(labellingTime).count());
+	logStream(LogLevel::Normal) << "Timing - Reading the strips took " << std::chrono::duration_cast<std::chrono::milliseconds>(readingTime).count() << "ms." << std::endl;
+	logStream(LogLevel::Normal) << "Timing - Mapping the strips to black and white (" << kernelName << ") took " << std::chrono::duration_cast<std::chrono::milliseconds>(thresholdingTime).count() << "ms." << std::endl;
+
+	profiler.beginStage("packing");
+	stripLabeller.packAreas();
+	StageProfiler::Stage const& packingStage = profiler.endStage();
+	logStream(LogLevel::Normal) << "Timing - Creating and merging the areas took " << (std::chrono::duration_cast<std::chrono::milliseconds>(labellingTime).count() + packingStage.getWallMilliseconds()) << "ms." << std::endl;
+	result.statistics.labelledAreaCount = stripLabeller.getLabelledAreaCount();
+	result.statistics.connectedAreaCount = stripLabeller.getAreaCount();
+	profiler.addCounter("provisionalLabels", stripLabeller.getLabelledAreaCount());
+	profiler.addCounter("merges", stripLabeller.getLabelledAreaCount() - stripLabeller.getAreaCount());
+	profiler.addCounter("areas", stripLabeller.getAreaCount());
+
+	logStream(LogLevel::Normal) << "Used " << stripLabeller.getLabelledAreaCount() << " areas, merged to a final amount of " << stripLabeller.getAreaCount() << " areas." << std::endl;
+
+	profiler.beginStage("smallAreaMerging");
+	std::size_t const absorbedAreas = stripLabeller.absorbSmallAreas(m_options.areaSizeThreshold);
+	logStream(LogLevel::Normal) << "Timing - Merging the small areas areas took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+	result.statistics.absorbedAreaCount = absorbedAreas;
+	profiler.addCounter("absorbedAreas", absorbedAreas);
+	profiler.addCounter("areas", stripLabeller.getAreaCount());
+
+	logStream(LogLevel::Normal) << "Merging " << absorbedAreas << " small areas brings us to a final amount of " << stripLabeller.getAreaCount() << " areas." << std::endl;
+	result.areaSizes.reserve(stripLabeller.getAreaCount());
+	for (int i = 0; i < stripLabeller.getAreaCount(); ++i) {
+		result.areaSizes.push_back(stripLabeller.getAreaMemberCount(i));
+		logStream(LogLevel::Verbose) << "\tArea " << i << " has " << result.areaSizes.back() << " members." << std::endl;
+	}
+
+	profiler.beginStage("lineForming");
+	auto const listOfLinesPerArea = stripLabeller.traceContoursPerArea();
+	logStream(LogLevel::Normal) << "Timing - Tracing the outlines along " << stripLabeller.getCrackCount() << " cracks took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+	profiler.addCounter("cracks", stripLabeller.getCrackCount());
+
+	std::vector<std::vector<Point> const*> const keptLines = runDeduplication(listOfLinesPerArea, profiler, result);
+	runRdp(keptLines, m_options.epsilon, profiler, result);
+	return true;
+}
+
+EdgeFinderPreview EdgeFinder::preview(ImageView const& image, int scale, bool isRefining) {
+	StageProfiler localProfiler;
+	StageProfiler& profiler = (m_profiler != nullptr) ? *m_profiler : localProfiler;
+	EdgeFinderPreview preview;
+	preview.scale = std::max(1, scale);
+	preview.isRefined = isRefining;
+	EdgeFinderResult& result = preview.result;
+
+	profiler.beginStage("downsampling");
+	int previewWidth = 0;
+	int previewHeight = 0;
+	std::vector<std::uint32_t> const previewPixels = downsampleImage(image, preview.scale, m_threadPool, previewWidth, previewHeight);
+	ImageView const previewImage = { reinterpret_cast<std::uint8_t const*>(previewPixels.data()), previewWidth, previewHeight, static_cast<std::size_t>(previewWidth) * sizeof(std::uint32_t), PixelFormat::Rgb32, {} };
+	logStream(LogLevel::Normal) << "Timing - Downsampling the image by " << preview.scale << " to " << previewWidth << " x " << previewHeight << " took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+	profiler.addCounter("scale", preview.scale);
+
+	// Areas shrink with the square of the scale. The deduplication epsilon stays, the outlines of neighbouring areas are one pixel apart at any scale.
+	EdgeFinderOptions previewOptions = m_options;
+	int const areaRatio = preview.scale * preview.scale;
+	previewOptions.areaSizeThreshold = (m_options.areaSizeThreshold + areaRatio / 2) / areaRatio;
+	logStream(LogLevel::Normal) << "Previewing with threshold = " << previewOptions.areaSizeThreshold << " for small area deletion." << std::endl;
+
+	result.width = previewWidth;
+	result.height = previewHeight;
+	result.crop = { 0, 0, previewWidth, previewHeight, previewWidth, previewHeight };
+	AreaInformation areas = runThresholdAndLabelling(previewImage, previewOptions, false, profiler, result);
+	runSmallAreaMerging(areas, previewOptions.areaSizeThreshold, profiler, result);
+	if (m_areasCallback) {
+		m_areasCallback(areas, result.crop, previewOptions);
+	}
+	auto const listOfLinesPerArea = runLineForming(areas, profiler, result);
+	std::vector<std::vector<Point> const*> const keptLines = runDeduplication(listOfLinesPerArea, profiler, result);
+
+	// Back to full resolution before RDP, so epsilon keeps its meaning. Pixels map to the centre of their block, corners stay corners.
+	profiler.beginStage(isRefining ? "refinement" : "upscaling");
+	bool const isTracingCorners = (m_options.lineFormerType == LineFormerType::Contour);
+	PointType const offset = isTracingCorners ? 0.0 : ((preview.scale - 1) / 2.0);
+	std::vector<std::vector<Point>> fullResolutionLines(keptLines.size());
+	for (std::size_t i = 0; i < keptLines.size(); ++i) {
+		fullResolutionLines[i].reserve(keptLines[i]->size());
+		for (auto const& point : *keptLines[i]) {
+			fullResolutionLines[i].push_back(std::make_pair(point.first * preview.scale + offset, point.second * preview.scale + offset));
+		}
+	}
+	if (isRefining) {
+		// Only the outlines of the preview are searched, the full resolution pipeline never runs
+		BitMask fullResolutionMask(image.width, image.height);
+		thresholdImage(image, m_options.colourThreshold, fullResolutionMask);
+		ThreadPool::TaskGroup taskGroup;
+		for (auto& line : fullResolutionLines) {
+			m_threadPool.run(taskGroup, [&fullResolutionMask, isTracingCorners, &preview, &line]() {
+				refineLine(fullResolutionMask, isTracingCorners, preview.scale, line);
+			});
+		}
+		m_threadPool.wait(taskGroup);
+	}
+	logStream(LogLevel::Normal) << "Timing - " << (isRefining ? "Refining" : "Scaling") << " the lines to full resolution took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+
+	std::vector<std::vector<Point> const*> fullResolutionLinePointers;
+	fullResolutionLinePointers.reserve(fullResolutionLines.size());
+	for (auto const& line : fullResolutionLines) {
+		fullResolutionLinePointers.push_back(&line);
+	}
+	runRdp(fullResolutionLinePointers, m_options.epsilon, profiler, result);
+
+	// Areas above the threshold survive the downsampling and keep their lines, but the outlines get longer with the scale
+	preview.estimatedAreaCount = static_cast<int>(result.areaSizes.size());
+	preview.estimatedLineCount = result.lines.size();
+	preview.estimatedPointCountBeforeRdp = result.statistics.pointCountBeforeRdp * preview.scale;
+	result.width = image.width;
+	result.height = image.height;
+	result.crop = { 0, 0, image.width, image.height, image.width, image.height };
+	result.areas = std::move(areas);
+	return preview;
+}
+
+int EdgeFinder::getPreviewScale(int width, int height, std::int64_t maxPixelCount) {
+	int scale = 1;
+	while ((static_cast<std::int64_t>((width + scale - 1) / scale) * ((height + scale - 1) / scale) > maxPixelCount) && (scale < std::max(width, height))) {
+		scale *= 2;
+	}
+	return scale;
+}
+
+void EdgeFinder::prepareBuffers(int width, int height, bool isMaskNeeded) {
+	if (isMaskNeeded && ((m_imageBw.getWidth() != width) || (m_imageBw.getHeight() != height))) {
+		m_imageBw = BitMask(width, height);
+	}
+	// The labels move into the result of every labelling, so they usually have to be allocated again
+	if ((m_areaInformation.getWidth() != width) || (m_areaInformation.getHeight() != height)) {
+		m_areaInformation = AreaInformation(width, height);
+	} else {
+		m_areaInformation.reset();
+	}
+}
+
+void EdgeFinder::reportCacheStore(char const* stageName, bool isStored, StageProfiler& profiler) {
+	long long const milliseconds = profiler.endStage().getWallMilliseconds();
+	if (isStored) {
+		logStream(LogLevel::Normal) << "Timing - Caching the " << stageName << " took " << milliseconds << "ms." << std::endl;
+	} else {
+		std::cerr << "Failed to write the " << stageName << " to the cache in '" << m_cache->getDirectory().toStdString() << "'!" << std::endl;
+	}
+}
+
+ImageView EdgeFinder::runCropping(ImageView const& image, StageProfiler& profiler, EdgeFinderResult& result) {
+	if (!m_options.isCropping) {
+		result.crop = { 0, 0, image.width, image.height, image.width, image.height };
+		return image;
+	}
+
+	profiler.beginStage("cropping");
+	result.crop = findContentBox(image);
+	ImageCrop const& crop = result.crop;
+	logStream(LogLevel::Normal) << "Timing - Finding the content box (" << crop.width << " x " << crop.height << " at " << crop.x << ", " << crop.y << ") took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+	profiler.addCounter("croppedPixels", static_cast<std::int64_t>(image.width) * image.height - static_cast<std::int64_t>(crop.width) * crop.height);
+	return cropImageView(image, crop);
+}
+
+void EdgeFinder::addCroppedPixels(AreaInformation& areas, ImageCrop const& crop) {
+	// The rows above and below the crop join its top and bottom margin rows, the columns beside it its left and right margin columns
+	int const above = crop.y * crop.imageWidth;
+	int const below = (crop.imageHeight - crop.y - crop.height) * crop.imageWidth;
+	int const left = crop.x * crop.height;
+	int const right = (crop.imageWidth - crop.x - crop.width) * crop.height;
+	if (above > 0) {
+		areas.addAreaMembers(areas.getArea(0, 0), above);
+	}
+	if (below > 0) {
+		areas.addAreaMembers(areas.getArea(0, crop.height - 1), below);
+	}
+	if (left > 0) {
+		areas.addAreaMembers(areas.getArea(0, 0), left);
+	}
+	if (right > 0) {
+		areas.addAreaMembers(areas.getArea(crop.width - 1, 0), right);
+	}
+}
+
+void EdgeFinder::runThreshold(ImageView const& image, int colourThreshold, StageProfiler& profiler) {
+	profiler.beginStage("threshold");
+	prepareBuffers(image.width, image.height, true);
+	thresholdImage(image, colourThreshold, m_imageBw);
+	logStream(LogLevel::Normal) << "Timing - Mapping the image to black and white (" << ImageThresholder(image, colourThreshold).getKernelName() << ") took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+}
+
+AreaInformation EdgeFinder::runLabelling(StageProfiler& profiler, EdgeFinderResult& result) {
+	profiler.beginStage("labelling");
+	labelAreas(m_options.labellerType, m_imageBw, m_areaInformation, m_threadPool);
+	return finishLabelling("Creating and merging the areas", profiler, result);
+}
+
+AreaInformation EdgeFinder::runThresholdAndLabelling(ImageView const& image, EdgeFinderOptions const& options, bool isMaskNeeded, StageProfiler& profiler, EdgeFinderResult& result) {
+	if (m_options.labellerType != LabellerType::Runs) {
+		runThreshold(image, options.colourThreshold, profiler);
+		if (m_blackWhiteMaskCallback) {
+			m_blackWhiteMaskCallback(m_imageBw, result.crop, options);
+		}
+		return runLabelling(profiler, result);
+	}
+
+	// Every row is read from the image once and labelled right away. Without anyone asking for the mask, only two rows of it exist at a time.
+	bool const isMaskKept = isMaskNeeded || m_blackWhiteMaskCallback;
+	profiler.beginStage("thresholdAndLabelling");
+	prepareBuffers(image.width, image.height, isMaskKept);
+	thresholdAndLabelAreas(image, options.colourThreshold, isMaskKept ? &m_imageBw : nullptr, m_areaInformation, m_threadPool);
+	profiler.addCounter("maskKept", isMaskKept ? 1 : 0);
+	AreaInformation areas = finishLabelling("Mapping the image to black and white (" + ImageThresholder(image, options.colourThreshold).getKernelName() + ") while creating and merging the areas", profiler, result);
+	if (m_blackWhiteMaskCallback) {
+		m_blackWhiteMaskCallback(m_imageBw, result.crop, options);
+	}
+	return areas;
+}
+
+AreaInformation EdgeFinder::finishLabelling(std::string const& timingDescription, StageProfiler& profiler, EdgeFinderResult& result) {
+	int const width = m_areaInformation.getWidth();
+	int const height = m_areaInformation.getHeight();
+
+	// How many areas for real? The labels are packed in place and handed over, so no second label image exists
+	int const labelledAreaCount = m_areaInformation.getAreaCount();
+	m_areaInformation.packAreas();
+	AreaInformation repackedAreas = std::move(m_areaInformation);
+	m_areaInformation = AreaInformation(0, 0);
+	logStream(LogLevel::Normal) << "Timing - " << timingDescription << " took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+	result.statistics.labelledAreaCount = labelledAreaCount;
+	result.statistics.connectedAreaCount = repackedAreas.getAreaCount();
+	// Every merge joins two provisional areas for good, so the difference to the packed areas is the number of merges
+	profiler.addCounter("provisionalLabels", labelledAreaCount);
+	profiler.addCounter("merges", labelledAreaCount - repackedAreas.getAreaCount());
+	profiler.addCounter("packIterations", static_cast<std::int64_t>(width) * height);
+	profiler.addCounter("areas", repackedAreas.getAreaCount());
+	profiler.addCounter("narrowLabels", repackedAreas.hasNarrowLabels() ? 1 : 0);
+
+	logStream(LogLevel::Normal) << "Used " << labelledAreaCount << " areas, merged to a final amount of " << repackedAreas.getAreaCount() << " areas." << std::endl;
+	return repackedAreas;
+}
+
+void EdgeFinder::runSmallAreaMerging(AreaInformation& areas, int areaSizeThreshold, StageProfiler& profiler, EdgeFinderResult& result) {
+	profiler.beginStage("smallAreaMerging");
+	// Absorb all areas < X into their largest neighbour, then relabel once
+	RegionAdjacencyGraph adjacencyGraph(areas);
+	std::size_t const absorbedAreas = adjacencyGraph.absorbSmallAreas(areaSizeThreshold, areas);
+	areas.packAreas();
+	logStream(LogLevel::Normal) << "Timing - Merging the small areas areas took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+	result.statistics.absorbedAreaCount = absorbedAreas;
+	profiler.addCounter("absorbedAreas", absorbedAreas);
+	profiler.addCounter("packIterations", static_cast<std::int64_t>(areas.getWidth()) * areas.getHeight());
+	profiler.addCounter("areas", areas.getAreaCount());
+
+	logStream(LogLevel::Normal) << "Merging " << absorbedAreas << " small areas brings us to a final amount of " << areas.getAreaCount() << " areas." << std::endl;
+	result.areaSizes.clear();
+	result.areaSizes.reserve(areas.getAreaCount());
+	for (int i = 0; i < areas.getAreaCount(); ++i) {
+		result.areaSizes.push_back(areas.getAreaMemberCount(i));
+		logStream(LogLevel::Verbose) << "\tArea " << i << " has " << result.areaSizes.back() << " members." << std::endl;
+	}
+}
+
+std::vector<std::vector<std::vector<Point>>> EdgeFinder::runLineForming(AreaInformation const& areas, StageProfiler& profiler, EdgeFinderResult& result) {
+	profiler.beginStage("lineForming");
+	std::size_t maxStackSize = 0;
+	auto listOfLinesPerArea = formLinesPerArea(m_options.lineFormerType, areas, maxStackSize);
+	logStream(LogLevel::Normal) << "Timing - Forming lines from the points took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+	if (m_options.lineFormerType == LineFormerType::PointSearch) {
+		logStream(LogLevel::Normal) << "Maximum stack depth was " << maxStackSize << "." << std::endl;
+		profiler.addCounter("maxDfsStackDepth", maxStackSize);
+		result.statistics.maxStackSize = maxStackSize;
+	}
+	return listOfLinesPerArea;
+}
+
+std::vector<std::vector<Point> const*> EdgeFinder::runDeduplication(std::vector<std::vector<std::vector<Point>>> const& listOfLinesPerArea, StageProfiler& profiler, EdgeFinderResult& result) {
+	EdgeFinderStatistics& statistics = result.statistics;
+
+	profiler.beginStage("deduplication");
+	std::vector<std::vector<Point> const*> keptLines = deduplicateLines(listOfLinesPerArea, m_options.deduplicationEpsilon);
+	logStream(LogLevel::Normal) << "Timing - Deduplication of lines took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+
+	statistics.lineCountBeforeDeduplication = 0;
+	for (auto const& lines : listOfLinesPerArea) {
+		statistics.lineCountBeforeDeduplication += lines.size();
+	}
+	statistics.deduplicatedLineCount = statistics.lineCountBeforeDeduplication - keptLines.size();
+	statistics.pointCountBeforeRdp = 0;
+	statistics.maxPointCountPerLineBefore = 0;
+	for (auto const line : keptLines) {
+		statistics.pointCountBeforeRdp += line->size();
+		statistics.maxPointCountPerLineBefore = std::max(statistics.maxPointCountPerLineBefore, line->size());
+	}
+	profiler.addCounter("deduplicatedLines", statistics.deduplicatedLineCount);
+	profiler.addCounter("keptLines", keptLines.size());
+	return keptLines;
+}
+
+void EdgeFinder::runRdp(std::vector<std::vector<Point> const*> const& keptLines, double epsilon, StageProfiler& profiler, EdgeFinderResult& result) {
+	EdgeFinderStatistics& statistics = result.statistics;
+
+	profiler.beginStage("rdp");
+	auto const rdpBusyTimeStart = m_threadPool.getBusyTime();
+	result.lines = simplifyLines(keptLines, epsilon, m_threadPool);
+	StageProfiler::Stage const& rdpStage = profiler.endStage();
+
+	double const rdpWallTime = rdpStage.wallMicroseconds / 1000000.0;
+	double const rdpBusyTime = std::chrono::duration<double>(m_threadPool.getBusyTime() - rdpBusyTimeStart).count();
+	logStream(LogLevel::Normal) << "Timing - Applying RDP on " << m_threadPool.getThreadCount() << " thread(s) took " << rdpStage.getWallMilliseconds() << "ms (estimated speedup against --threads 1: " << ((rdpWallTime > 0.0) ? (rdpBusyTime / rdpWallTime) : 1.0) << "x)." << std::endl;
+
+	statistics.pointCountAfterRdp = 0;
+	statistics.maxPointCountPerLineAfter = 0;
+	for (auto const& line : result.lines) {
+		statistics.pointCountAfterRdp += line.size();
+		statistics.maxPointCountPerLineAfter = std::max(statistics.maxPointCountPerLineAfter, line.size());
+	}
+	profiler.addCounter("threads", m_threadPool.getThreadCount());
+	profiler.addCounter("pointsBeforeRdp", statistics.pointCountBeforeRdp);
+	profiler.addCounter("pointsAfterRdp", statistics.pointCountAfterRdp);
+	logStream(LogLevel::Normal) << "We got " << result.lines.size() << " lines (removed from deduplication: " << statistics.deduplicatedLineCount << ") with " << statistics.pointCountBeforeRdp << " points (longest: " << statistics.maxPointCountPerLineBefore << " points, average: " << (result.lines.empty() ? 0 : (statistics.pointCountBeforeRdp / result.lines.size())) << " points)." << std::endl;
+	logStream(LogLevel::Normal) << "After applying RDP, we have " << result.lines.size() << " lines with " << statistics.pointCountAfterRdp << " points (longest: " << statistics.maxPointCountPerLineAfter << ", average: " << (result.lines.empty() ? 0 : (statistics.pointCountAfterRdp / result.lines.size())) << ")." << std::endl;
+}
@@ -0,0 +1,193 @@
+#ifndef EDGEFINDER_EDGEFINDER_H_
+#define EDGEFINDER_EDGEFINDER_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <QImage>
+
+#include "AreaInformation.h"
+#include "AreaLabeller.h"
+#include "BitMask.h"
+#include "ContourTracer.h"
+#include "ImageView.h"
+#include "Point.h"
+#include "StageProfiler.h"
+#include "ThreadPool.h"
+
+class StageCache;
+
+struct EdgeFinderOptions {
+	EdgeFinderOptions() : colourThreshold(64), areaSizeThreshold(500), epsilon(0.01), deduplicationEpsilon(2.0), labellerType(LabellerType::Runs), lineFormerType(LineFormerType::PointSearch), isCropping(true) {
+		//
+	}
+
+	// A pixel is white if every RGB component is greater than this
+	int colourThreshold;
+	// Areas with fewer pixels are absorbed into their largest neighbour
+	int areaSizeThreshold;
+	// Tolerance of the Ramer-Douglas-Peucker simplification
+	double epsilon;
+	// Lines with a point closer than this to the start of an earlier line are dropped, 0 keeps all lines
+	double deduplicationEpsilon;
+	LabellerType labellerType;
+	LineFormerType lineFormerType;
+	// Whether process() and sweep() only run the stages on the content box of the image, see findContentBox()
+	bool isCropping;
+};
+
+// Values for a parameter sweep, every combination of them is processed
+struct EdgeFinderSweep {
+	std::vector<int> colourThresholds;
+	std::vector<int> areaSizeThresholds;
+	std::vector<double> epsilons;
+};
+
+// Returns the image itself if makeImageView() can borrow its pixels as they are, otherwise a 32bit copy converted like QImage::pixel() would see it.
+// RGB32, ARGB32, RGB888, Grayscale8 and Indexed8 images are never copied.
+QImage toSupportedFormat(QImage const& image);
+
+// Borrows the pixels of an image returned by toSupportedFormat()
+ImageView makeImageView(QImage const& image);
+
+struct EdgeFinderStatistics {
+	// Areas as labelled, after joining connected ones and after absorbing the small ones
+	int labelledAreaCount;
+	int connectedAreaCount;
+	std::size_t absorbedAreaCount;
+	// Deepest stack of the point search, 0 for the contour tracer
+	std::size_t maxStackSize;
+	std::size_t lineCountBeforeDeduplication;
+	std::size_t deduplicatedLineCount;
+	std::size_t pointCountBeforeRdp;
+	std::size_t maxPointCountPerLineBefore;
+	std::size_t pointCountAfterRdp;
+	std::size_t maxPointCountPerLineAfter;
+};
+
+struct EdgeFinderResult {
+	EdgeFinderResult() : width(0), height(0), crop({ 0, 0, 0, 0, 0, 0 }), lines(), areas(0, 0), areaSizes(), statistics() {
+		//
+	}
+
+	int width;
+	int height;
+	// The part of the image the stages ran on, the whole image unless it was cropped
+	ImageCrop crop;
+	// The simplified outlines, relative to the top left corner of the crop
+	std::vector<std::vector<Point>> lines;
+	// The final label of every pixel of the crop, empty when processed in strips or swept. Pixels outside of it count towards the areas at its margin.
+	AreaInformation areas;
+	// Pixels per final area
+	std::vector<int> areaSizes;
+	EdgeFinderStatistics statistics;
+};
+
+struct EdgeFinderPreview {
+	EdgeFinderPreview() : scale(1), isRefined(false), result(), estimatedAreaCount(0), estimatedLineCount(0), estimatedPointCountBeforeRdp(0) {
+		//
+	}
+
+	// Every preview pixel averages a block of scale x scale image pixels
+	int scale;
+	// Whether the points of the lines were moved onto the full resolution outlines
+	bool isRefined;
+	// Width, height and lines are in full resolution coordinates, areas, area sizes and statistics are those of the downsampled image
+	EdgeFinderResult result;
+	// What a full resolution run would roughly report
+	int estimatedAreaCount;
+	std::size_t estimatedLineCount;
+	std::size_t estimatedPointCountBeforeRdp;
+};
+
+/*
+	The vectorisation pipeline: threshold, label, merge small areas, form lines, deduplicate and simplify them.
+	Works on pixels in memory and returns the result without touching the filesystem. Buffers that only depend on the image size are kept
+	between calls, so one instance per thread serves a stream of images. Timing lines go to logStream(), set LogLevel::Quiet to silence them.
+*/
+class EdgeFinder {
+public:
+	EdgeFinder(EdgeFinderOptions const& options, ThreadPool& threadPool);
+
+	EdgeFinderOptions const& getOptions() const;
+
+	void setOptions(EdgeFinderOptions const& options);
+
+	// Stages and counters are recorded into this profiler, which has to outlive the calls. Without one, they are only timed for the log.
+	void setProfiler(StageProfiler* profiler);
+
+	// process() stores the mask, the areas and the lines into this cache and continues behind the deepest of them it finds there.
+	// The cache has to outlive the calls, sweeps and strips do not use it.
+	void setCache(StageCache* cache);
+
+	// Called as soon as the black and white mask and the final area labels exist, e.g. to write diagnostic images while the pipeline continues.
+	// Both cover the crop of the image and the options are the ones they were made with. No stage is running during the calls, so they may record their own.
+	typedef std::function<void(BitMask const& imageBw, ImageCrop const& crop, EdgeFinderOptions const& options)> BlackWhiteMaskCallback;
+	typedef std::function<void(AreaInformation const& areas, ImageCrop const& crop, EdgeFinderOptions const& options)> AreasCallback;
+	void setBlackWhiteMaskCallback(BlackWhiteMaskCallback callback);
+	void setAreasCallback(AreasCallback callback);
+
+	EdgeFinderResult process(ImageView const& image);
+
+	typedef std::function<void(EdgeFinderOptions const& options, EdgeFinderResult const& result)> SweepCallback;
+
+	// Calls onResult for every combination of the sweep values, the other options stay. Every stage only runs again when a value it depends on changes:
+	// thresholding and labelling per colour threshold, small area merging, line forming and deduplication per area size threshold and RDP per epsilon.
+	void sweep(ImageView const& image, EdgeFinderSweep const& sweep, SweepCallback const& onResult);
+
+	// Fills strip with the rows [firstRow, firstRow + rowCount) of the image, returns false if they could not be read.
+	// The pixels have to stay valid until the next call.
+	typedef std::function<bool(int firstRow, int rowCount, ImageView& strip)> StripReader;
+
+	// Same result as process() with the contour tracer, but reads, thresholds and labels stripHeight rows at a time,
+	// so the labels of the whole image never exist at once. No mask or area callbacks are made. Returns false if a strip could not be read.
+	bool processInStrips(int width, int height, int stripHeight, StripReader const& readStrip, EdgeFinderResult& result);
+
+	// Runs the stages on the image downsampled by scale, with areaSizeThreshold scaled down by the area ratio, to check the thresholds quickly.
+	// The lines are scaled back up before RDP. With isRefining, their points are first moved onto the nearest full resolution outline within scale pixels.
+	// The mask and area callbacks see the downsampled image, with the scaled options.
+	EdgeFinderPreview preview(ImageView const& image, int scale, bool isRefining);
+
+	// The smallest power of two that downsamples the image to at most maxPixelCount pixels
+	static int getPreviewScale(int width, int height, std::int64_t maxPixelCount);
+private:
+	EdgeFinderOptions m_options;
+	ThreadPool& m_threadPool;
+	StageProfiler* m_profiler;
+	StageCache* m_cache;
+	BlackWhiteMaskCallback m_blackWhiteMaskCallback;
+	AreasCallback m_areasCallback;
+
+	// Kept between images of the same size
+	BitMask m_imageBw;
+	AreaInformation m_areaInformation;
+
+	// The stages of process(), each records itself into the profiler and its statistics into result
+	// Sizes m_areaInformation for the image and resets it for the next labelling, and m_imageBw as well if isMaskNeeded
+	void prepareBuffers(int width, int height, bool isMaskNeeded);
+	// Ends the running cacheStoring stage
+	void reportCacheStore(char const* stageName, bool isStored, StageProfiler& profiler);
+
+	// Sets result.crop and returns the part of the image the other stages run on
+	ImageView runCropping(ImageView const& image, StageProfiler& profiler, EdgeFinderResult& result);
+	// Counts the pixels around the crop towards the areas of its margin, which they are connected to, so the sizes are those of the whole image
+	void addCroppedPixels(AreaInformation& areas, ImageCrop const& crop);
+
+	void runThreshold(ImageView const& image, int colourThreshold, StageProfiler& profiler);
+	// Labels m_imageBw and returns the packed connected areas
+	AreaInformation runLabelling(StageProfiler& profiler, EdgeFinderResult& result);
+	// Thresholds and labels the image, in a single pass with the runs labeller. m_imageBw only receives the mask if isMaskNeeded or
+	// a mask callback is set, which is called with options once it exists. Returns the packed connected areas.
+	AreaInformation runThresholdAndLabelling(ImageView const& image, EdgeFinderOptions const& options, bool isMaskNeeded, StageProfiler& profiler, EdgeFinderResult& result);
+	// Packs m_areaInformation after labelling, ends the running stage and hands the areas over
+	AreaInformation finishLabelling(std::string const& timingDescription, StageProfiler& profiler, EdgeFinderResult& result);
+	void runSmallAreaMerging(AreaInformation& areas, int areaSizeThreshold, StageProfiler& profiler, EdgeFinderResult& result);
+	std::vector<std::vector<std::vector<Point>>> runLineForming(AreaInformation const& areas, StageProfiler& profiler, EdgeFinderResult& result);
+	std::vector<std::vector<Point> const*> runDeduplication(std::vector<std::vector<std::vector<Point>>> const& listOfLinesPerArea, StageProfiler& profiler, EdgeFinderResult& result);
+	// Simplifies the kept lines into result.lines
+	void runRdp(std::vector<std::vector<Point> const*> const& keptLines, double epsilon, StageProfiler& profiler, EdgeFinderResult& result);
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "ImageView.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	// Pixels compared per memcmp()
+	int const tileSize = 64;
+
+	// The first pixel in [begin, end) of row that differs from background, or end
+	int findFirstDifference(std::uint8_t const* row, std::uint8_t const* background, int bytesPerPixel, int begin, int end) {
+		for (int tile = begin; tile < end; tile += tileSize) {
+			int const tileEnd = std::min(end, tile + tileSize);
+			if (std::memcmp(row + tile * bytesPerPixel, background, static_cast<std::size_t>(tileEnd - tile) * bytesPerPixel) == 0) {
+				continue;
+			}
+			for (int x = tile; x < tileEnd; ++x) {
+				if (std::memcmp(row + x * bytesPerPixel, background, bytesPerPixel) != 0) {
+					return x;
+				}
+			}
+		}
+		return end;
+	}
+
+	// The last pixel in [begin, end) of row that differs from background, or begin - 1
+	int findLastDifference(std::uint8_t const* row, std::uint8_t const* background, int bytesPerPixel, int begin, int end) {
+		for (int tileEnd = end; tileEnd > begin; tileEnd -= tileSize) {
+			int const tile = std::max(begin, tileEnd - tileSize);
+			if (std::memcmp(row + tile * bytesPerPixel, background, static_cast<std::size_t>(tileEnd - tile) * bytesPerPixel) == 0) {
+				continue;
+			}
+			for (int x = tileEnd - 1; x >= tile; --x) {
+				if (std::memcmp(row + x * bytesPerPixel, background, bytesPerPixel) != 0) {
+					return x;
+				}
+			}
+		}
+		return begin - 1;
+	}
+}
+
+int getBytesPerPixel(PixelFormat format) {
+	switch (format) {
+		case PixelFormat::Rgb32:
+			return 4;
+		case PixelFormat::Rgb888:
+			return 3;
+		case PixelFormat::Grayscale8:
+		case PixelFormat::Indexed8:
+			return 1;
+	}
+	return 4;
+}
+
+std::uint32_t const* getRgb32Row(ImageView const& image, int y, std::uint32_t* buffer) {
+	std::uint8_t const* const row = image.pixels + static_cast<std::size_t>(y) * image.bytesPerLine;
+	switch (image.format) {
+		case PixelFormat::Rgb32:
+			return reinterpret_cast<std::uint32_t const*>(row);
+		case PixelFormat::Rgb888:
+			for (int x = 0; x < image.width; ++x) {
+				buffer[x] = 0xFF000000u | (static_cast<std::uint32_t>(row[3 * x]) << 16) | (static_cast<std::uint32_t>(row[3 * x + 1]) << 8) | row[3 * x + 2];
+			}
+			break;
+		case PixelFormat::Grayscale8:
+			for (int x = 0; x < image.width; ++x) {
+				buffer[x] = 0xFF000000u | (row[x] * 0x010101u);
+			}
+			break;
+		case PixelFormat::Indexed8:
+			for (int x = 0; x < image.width; ++x) {
+				buffer[x] = (row[x] < image.palette.size()) ? image.palette[row[x]] : 0u;
+			}
+			break;
+	}
+	return buffer;
+}
+
+char const* getPixelFormatName(PixelFormat format) {
+	switch (format) {
+		case PixelFormat::Rgb32:
+			return "RGB32";
+		case PixelFormat::Rgb888:
+			return "RGB888";
+		case PixelFormat::Grayscale8:
+			return "Grayscale8";
+		case PixelFormat::Indexed8:
+			return "Indexed8";
+	}
+	return "unknown";
+}
+
+ImageCrop findContentBox(ImageView const& image) {
+	int const width = image.width;
+	int const height = image.height;
+	if ((width <= 0) || (height <= 0)) {
+		return { 0, 0, width, height, width, height };
+	}
+
+	// One tile of the border colour is enough to compare against, it is the same at every position
+	int const bytesPerPixel = getBytesPerPixel(image.format);
+	std::vector<std::uint8_t> background(static_cast<std::size_t>(tileSize) * bytesPerPixel);
+	for (int x = 0; x < tileSize; ++x) {
+		std::memcpy(background.data() + x * bytesPerPixel, image.pixels, bytesPerPixel);
+	}
+	auto const getRow = [&image](int y) {
+		return image.pixels + static_cast<std::size_t>(y) * image.bytesPerLine;
+	};
+
+	int top = 0;
+	while ((top < height) && (findFirstDifference(getRow(top), background.data(), bytesPerPixel, 0, width) == width)) {
+		++top;
+	}
+	if (top == height) {
+		return { 0, 0, 1, 1, width, height };
+	}
+	int bottom = height - 1;
+	while (findFirstDifference(getRow(bottom), background.data(), bytesPerPixel, 0, width) == width) {
+		--bottom;
+	}
+	int left = width;
+	int right = -1;
+	for (int y = top; y <= bottom; ++y) {
+		left = findFirstDifference(getRow(y), background.data(), bytesPerPixel, 0, left);
+		right = findLastDifference(getRow(y), background.data(), bytesPerPixel, right + 1, width);
+	}
+
+	int const x = std::max(0, left - 1);
+	int const y = std::max(0, top - 1);
+	return { x, y, std::min(width, right + 2) - x, std::min(height, bottom + 2) - y, width, height };
+}
+
+ImageView cropImageView(ImageView const& image, ImageCrop const& crop) {
+	ImageView view = image;
+	view.pixels = image.pixels + static_cast<std::size_t>(crop.y) * image.bytesPerLine + static_cast<std::size_t>(crop.x) * getBytesPerPixel(image.format);
+	view.width = crop.width;
+	view.height = crop.height;
+	return view;
+}
@@ -0,0 +1,57 @@
+#ifndef EDGEFINDER_IMAGEVIEW_H_
+#define EDGEFINDER_IMAGEVIEW_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Layouts of pixels the pipeline reads directly, each has its own threshold kernel
+enum class PixelFormat {
+	// 32bit 0xAARRGGBB (QImage::Format_RGB32 or Format_ARGB32), the alpha is ignored
+	Rgb32,
+	// Three bytes R, G, B (QImage::Format_RGB888)
+	Rgb888,
+	// One grey byte (QImage::Format_Grayscale8)
+	Grayscale8,
+	// One byte indexing the palette (QImage::Format_Indexed8)
+	Indexed8
+};
+
+// Borrowed pixels, rows bytesPerLine apart. Nothing is copied but the palette of indexed images.
+struct ImageView {
+	std::uint8_t const* pixels;
+	int width;
+	int height;
+	std::size_t bytesPerLine;
+	PixelFormat format;
+	// The 0xAARRGGBB colours of Indexed8 pixels, indices past its end are transparent black like QImage::pixel() sees them
+	std::vector<std::uint32_t> palette;
+};
+
+// The pixels [x, x + width) x [y, y + height) of an image of imageWidth x imageHeight pixels
+struct ImageCrop {
+	int x;
+	int y;
+	int width;
+	int height;
+	int imageWidth;
+	int imageHeight;
+};
+
+int getBytesPerPixel(PixelFormat format);
+
+// Row y as 0xAARRGGBB pixels, the same QImage::pixel() returns. That is the row itself for Rgb32, the others are converted into buffer,
+// which has to hold width pixels.
+std::uint32_t const* getRgb32Row(ImageView const& image, int y, std::uint32_t* buffer);
+
+char const* getPixelFormatName(PixelFormat format);
+
+// The bounding box of the pixels that differ from the top left one, grown by a margin of one pixel and clipped to the image.
+// Rows are compared a tile at a time against a row of the border colour, the top and bottom scans stop at the first differing row
+// and the left and right ones only look outside of the box found so far. A uniform image gives its top left pixel.
+ImageCrop findContentBox(ImageView const& image);
+
+// Borrows the cropped pixels of the image, no pixel is copied
+ImageView cropImageView(ImageView const& image, ImageCrop const& crop);
+
+#endif
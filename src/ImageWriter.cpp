@@ -0,0 +1,88 @@
+#include "ImageWriter.h"
+
+#include <iostream>
+
+#include "Log.h"
+
+ImageWriter::ImageWriter(bool isAsynchronous) : m_isAsynchronous(isAsynchronous), m_mutex(), m_condition(), m_pendingWrites(), m_finishedWrites(), m_isWriting(false), m_isStopping(false), m_thread() {
+	if (m_isAsynchronous) {
+		m_thread = std::thread(&ImageWriter::writerLoop, this);
+	}
+}
+
+ImageWriter::~ImageWriter() {
+	if (m_isAsynchronous) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_isStopping = true;
+		}
+		m_condition.notify_all();
+		m_thread.join();
+	}
+}
+
+bool ImageWriter::isAsynchronous() const {
+	return m_isAsynchronous;
+}
+
+void ImageWriter::save(QImage const& image, QString const& fileName) {
+	if (!m_isAsynchronous) {
+		if (!image.save(fileName)) {
+			std::cerr << "Failed to write image '" << fileName.toStdString() << "'!" << std::endl;
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pendingWrites.push_back({ image, fileName, std::chrono::steady_clock::now() });
+	}
+	m_condition.notify_all();
+}
+
+void ImageWriter::waitForPendingWrites() {
+	if (!m_isAsynchronous) {
+		return;
+	}
+
+	auto const timeWaitStart = std::chrono::steady_clock::now();
+	std::vector<FinishedWrite> finishedWrites;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [this]() { return m_pendingWrites.empty() && !m_isWriting; });
+		finishedWrites.swap(m_finishedWrites);
+	}
+	auto const timeWaitEnd = std::chrono::steady_clock::now();
+
+	for (FinishedWrite const& write : finishedWrites) {
+		if (!write.isOk) {
+			std::cerr << "Failed to write image '" << write.fileName.toStdString() << "'!" << std::endl;
+		}
+		logStream(LogLevel::Normal) << "Timing - Writing " << write.fileName.toStdString() << " in the background took " << std::chrono::duration_cast<std::chrono::milliseconds>(write.writeTime).count() << "ms (after " << std::chrono::duration_cast<std::chrono::milliseconds>(write.queuedTime).count() << "ms in the queue)." << std::endl;
+	}
+	logStream(LogLevel::Normal) << "Timing - Waiting for pending image writes took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeWaitEnd - timeWaitStart).count() << "ms." << std::endl;
+}
+
+void ImageWriter::writerLoop() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		m_condition.wait(lock, [this]() { return m_isStopping || !m_pendingWrites.empty(); });
+		if (m_pendingWrites.empty()) {
+			return;
+		}
+
+		PendingWrite write = std::move(m_pendingWrites.front());
+		m_pendingWrites.pop_front();
+		m_isWriting = true;
+		lock.unlock();
+
+		auto const timeWriteStart = std::chrono::steady_clock::now();
+		bool const isOk = write.image.save(write.fileName);
+		auto const timeWriteEnd = std::chrono::steady_clock::now();
+
+		lock.lock();
+		m_finishedWrites.push_back({ write.fileName, isOk, timeWriteEnd - timeWriteStart, timeWriteStart - write.queuedAt });
+		m_isWriting = false;
+		m_condition.notify_all();
+	}
+}
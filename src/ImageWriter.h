@@ -0,0 +1,58 @@
+#ifndef EDGEFINDER_IMAGEWRITER_H_
+#define EDGEFINDER_IMAGEWRITER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <QImage>
+#include <QString>
+
+/*
+	Saves the diagnostic images, either right away or on a background thread so the pipeline does not wait for the PNG encoder.
+	Timings of background writes are collected and printed by waitForPendingWrites() on the calling thread.
+*/
+class ImageWriter {
+public:
+	explicit ImageWriter(bool isAsynchronous);
+	~ImageWriter();
+
+	ImageWriter(ImageWriter const&) = delete;
+	ImageWriter& operator=(ImageWriter const&) = delete;
+
+	bool isAsynchronous() const;
+
+	// The image is shared with the writer, it must not be modified afterwards.
+	void save(QImage const& image, QString const& fileName);
+
+	void waitForPendingWrites();
+private:
+	struct PendingWrite {
+		QImage image;
+		QString fileName;
+		std::chrono::steady_clock::time_point queuedAt;
+	};
+
+	struct FinishedWrite {
+		QString fileName;
+		bool isOk;
+		std::chrono::steady_clock::duration writeTime;
+		std::chrono::steady_clock::duration queuedTime;
+	};
+
+	bool const m_isAsynchronous;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<PendingWrite> m_pendingWrites;
+	std::vector<FinishedWrite> m_finishedWrites;
+	bool m_isWriting;
+	bool m_isStopping;
+	std::thread m_thread;
+
+	void writerLoop();
+};
+
+#endif
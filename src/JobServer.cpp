@@ -0,0 +1,281 @@
+#include "JobServer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include "SvgBuilder.h"
+
+namespace {
+	std::size_t const latencyWindow = 1024;
+
+	// A number or integer field of a job may be missing, then the default stays
+	bool readNumber(QJsonObject const& request, QString const& key, double minimum, double& value, QString& error) {
+		QJsonValue const field = request.value(key);
+		if (field.isUndefined()) {
+			return true;
+		}
+		if (!field.isDouble()) {
+			error = "'" + key + "' has to be a number";
+			return false;
+		}
+		if (!(field.toDouble() >= minimum)) {
+			error = "'" + key + "' has to be at least " + QString::number(minimum);
+			return false;
+		}
+		value = field.toDouble();
+		return true;
+	}
+
+	bool readInteger(QJsonObject const& request, QString const& key, int minimum, int& value, QString& error) {
+		double number = value;
+		if (!readNumber(request, key, std::numeric_limits<double>::lowest(), number, error)) {
+			return false;
+		}
+		// Checked before the cast, which is undefined for values outside of the int range
+		if ((number != std::floor(number)) || (number < minimum) || (number > std::numeric_limits<int>::max())) {
+			error = "'" + key + "' has to be an integer from " + QString::number(minimum) + " to " + QString::number(std::numeric_limits<int>::max());
+			return false;
+		}
+		value = static_cast<int>(number);
+		return true;
+	}
+
+	std::int64_t getMicrosecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+	}
+}
+
+JobServer::JobServer(EdgeFinderOptions const& defaultOptions, ThreadPool& threadPool, int maxJobs, std::ostream& output) : m_defaultOptions(defaultOptions), m_threadPool(threadPool), m_maxJobs(std::max(1, maxJobs)), m_output(output), m_startedAt(std::chrono::steady_clock::now()), m_mutex(), m_jobAvailable(), m_jobs(), m_isStopping(false), m_workers(), m_receivedJobCount(0), m_completedJobCount(0), m_failedJobCount(0), m_runningJobCount(0), m_latencies(), m_nextLatency(0), m_outputMutex() {
+	for (int i = 0; i < m_maxJobs; ++i) {
+		m_workers.emplace_back(&JobServer::workerLoop, this);
+	}
+}
+
+JobServer::~JobServer() {
+	stop();
+}
+
+void JobServer::run(std::istream& input) {
+	std::string line;
+	while (std::getline(input, line)) {
+		QByteArray const requestBytes = QByteArray(line.data(), static_cast<int>(line.size())).trimmed();
+		if (requestBytes.isEmpty()) {
+			continue;
+		}
+
+		QJsonParseError parseError;
+		QJsonDocument const document = QJsonDocument::fromJson(requestBytes, &parseError);
+		if (!document.isObject()) {
+			writeResponse({ { "ok", false }, { "error", "Request is not a JSON object: " + parseError.errorString() } });
+			continue;
+		}
+		QJsonObject const request = document.object();
+		QJsonValue const id = request.value("id");
+		QString const command = request.value("command").toString("process");
+		if (command == "stats") {
+			QJsonObject response = { { "ok", true }, { "stats", getStatistics() } };
+			if (!id.isUndefined()) {
+				response.insert("id", id);
+			}
+			writeResponse(response);
+		} else if (command == "quit") {
+			break;
+		} else if (command == "process") {
+			Job job;
+			QString error;
+			if (!parseJob(request, job, error)) {
+				QJsonObject response = { { "ok", false }, { "error", error } };
+				if (!id.isUndefined()) {
+					response.insert("id", id);
+				}
+				writeResponse(response);
+				continue;
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_jobs.push_back(std::move(job));
+				++m_receivedJobCount;
+			}
+			m_jobAvailable.notify_one();
+		} else {
+			writeResponse({ { "ok", false }, { "error", "Unknown command '" + command + "', expected 'process', 'stats' or 'quit'" } });
+		}
+	}
+	stop();
+}
+
+QJsonObject JobServer::getStatistics() const {
+	std::vector<std::int64_t> latencies;
+	QJsonObject statistics;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		latencies = m_latencies;
+		statistics.insert("receivedJobs", static_cast<qint64>(m_receivedJobCount));
+		statistics.insert("completedJobs", static_cast<qint64>(m_completedJobCount));
+		statistics.insert("failedJobs", static_cast<qint64>(m_failedJobCount));
+		statistics.insert("queueDepth", static_cast<int>(m_jobs.size()));
+		statistics.insert("runningJobs", m_runningJobCount);
+	}
+	statistics.insert("maxJobs", m_maxJobs);
+	statistics.insert("threads", m_threadPool.getThreadCount());
+	statistics.insert("uptimeMilliseconds", static_cast<qint64>(getMicrosecondsBetween(m_startedAt, std::chrono::steady_clock::now()) / 1000));
+
+	// Over the last jobs only, so the numbers follow the current load
+	std::sort(latencies.begin(), latencies.end());
+	auto const percentile = [&latencies](double fraction) -> qint64 {
+		if (latencies.empty()) {
+			return 0;
+		}
+		std::size_t const index = static_cast<std::size_t>(std::ceil(fraction * latencies.size())) - 1;
+		return latencies[std::min(index, latencies.size() - 1)];
+	};
+	statistics.insert("latencySamples", static_cast<int>(latencies.size()));
+	statistics.insert("latencyP50Microseconds", percentile(0.5));
+	statistics.insert("latencyP95Microseconds", percentile(0.95));
+	statistics.insert("latencyMaxMicroseconds", percentile(1.0));
+	return statistics;
+}
+
+bool JobServer::parseJob(QJsonObject const& request, Job& job, QString& error) const {
+	job.id = request.value("id");
+	job.options = m_defaultOptions;
+	job.receivedAt = std::chrono::steady_clock::now();
+
+	if (request.value("image").isString()) {
+		job.imageFile = request.value("image").toString();
+	} else if (request.value("imageData").isString()) {
+		job.imageData = QByteArray::fromBase64(request.value("imageData").toString().toLatin1());
+	} else {
+		error = "A job needs either 'image' with the path of an image or 'imageData' with a base64 encoded image file";
+		return false;
+	}
+
+	QString const output = request.value("output").toString("svg");
+	if ((output != "svg") && (output != "lines")) {
+		error = "'output' has to be 'svg' or 'lines'";
+		return false;
+	}
+	job.isReturningLines = (output == "lines");
+
+	// The same ranges as on the command line
+	return readNumber(request, "epsilon", 0.0, job.options.epsilon, error)
+		&& readNumber(request, "deduplicationEpsilon", 0.0, job.options.deduplicationEpsilon, error)
+		&& readInteger(request, "areaSizeThreshold", 0, job.options.areaSizeThreshold, error)
+		&& readInteger(request, "colourThreshold", std::numeric_limits<int>::min(), job.options.colourThreshold, error);
+}
+
+QJsonObject JobServer::processJob(Job const& job, EdgeFinder& edgeFinder) const {
+	QImage image;
+	if (job.imageFile.isEmpty()) {
+		image.loadFromData(job.imageData);
+	} else {
+		image.load(job.imageFile);
+	}
+	if (image.isNull()) {
+		return { { "ok", false }, { "error", QString("The image could not be read") } };
+	}
+
+	QImage const supportedImage = toSupportedFormat(image);
+	edgeFinder.setOptions(job.options);
+	EdgeFinderResult const result = edgeFinder.process(makeImageView(supportedImage));
+
+	QJsonObject response = { { "ok", true }, { "width", result.width }, { "height", result.height } };
+	if (job.isReturningLines) {
+		// In image coordinates, like the SVG
+		QJsonArray lines;
+		for (auto const& line : result.lines) {
+			QJsonArray points;
+			for (auto const& point : line) {
+				points.append(QJsonArray({ point.first + result.crop.x, point.second + result.crop.y }));
+			}
+			lines.append(points);
+		}
+		response.insert("lines", lines);
+	} else {
+		double const targetW = 297.0;
+		double const targetH = 210.0;
+		SvgBuilder svgBuilder(result.width, result.height, targetW, targetH, result.crop.x, result.crop.y);
+		response.insert("svg", svgBuilder.buildSvgFromLines(result.lines));
+	}
+
+	QJsonObject statistics;
+	statistics.insert("areas", static_cast<int>(result.areaSizes.size()));
+	statistics.insert("absorbedAreas", static_cast<qint64>(result.statistics.absorbedAreaCount));
+	statistics.insert("lines", static_cast<qint64>(result.lines.size()));
+	statistics.insert("pointsBeforeRdp", static_cast<qint64>(result.statistics.pointCountBeforeRdp));
+	statistics.insert("pointsAfterRdp", static_cast<qint64>(result.statistics.pointCountAfterRdp));
+	response.insert("statistics", statistics);
+	return response;
+}
+
+void JobServer::workerLoop() {
+	// Every worker keeps its own pipeline, so the buffers stay warm for images of the same size
+	EdgeFinder edgeFinder(m_defaultOptions, m_threadPool);
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [this]() { return m_isStopping || !m_jobs.empty(); });
+			if (m_jobs.empty()) {
+				return;
+			}
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			++m_runningJobCount;
+		}
+
+		auto const processingStart = std::chrono::steady_clock::now();
+		QJsonObject response = processJob(job, edgeFinder);
+		auto const processingEnd = std::chrono::steady_clock::now();
+		bool const isOk = response.value("ok").toBool();
+		if (!job.id.isUndefined()) {
+			response.insert("id", job.id);
+		}
+		response.insert("queueMicroseconds", static_cast<qint64>(getMicrosecondsBetween(job.receivedAt, processingStart)));
+		response.insert("processingMicroseconds", static_cast<qint64>(getMicrosecondsBetween(processingStart, processingEnd)));
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_runningJobCount;
+			if (isOk) {
+				++m_completedJobCount;
+			} else {
+				++m_failedJobCount;
+			}
+			std::int64_t const latency = getMicrosecondsBetween(job.receivedAt, processingEnd);
+			if (m_latencies.size() < latencyWindow) {
+				m_latencies.push_back(latency);
+			} else {
+				m_latencies[m_nextLatency] = latency;
+			}
+			m_nextLatency = (m_nextLatency + 1) % latencyWindow;
+		}
+		writeResponse(response);
+	}
+}
+
+void JobServer::stop() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_jobAvailable.notify_all();
+	for (auto& worker : m_workers) {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+}
+
+void JobServer::writeResponse(QJsonObject const& response) {
+	QByteArray const json = QJsonDocument(response).toJson(QJsonDocument::Compact);
+	std::lock_guard<std::mutex> lock(m_outputMutex);
+	m_output.write(json.constData(), json.size());
+	m_output << std::endl;
+}
@@ -0,0 +1,82 @@
+#ifndef EDGEFINDER_JOBSERVER_H_
+#define EDGEFINDER_JOBSERVER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+#include "EdgeFinder.h"
+#include "ThreadPool.h"
+
+/*
+	Serves vectorisation jobs given as one JSON object per line, and answers each with one JSON line, in the order the jobs finish:
+		{"id": 1, "image": "path/to/image.png", "epsilon": 2.0, "output": "svg"}
+		{"id": 2, "imageData": "<base64 encoded image file>", "areaSizeThreshold": 50, "output": "lines"}
+		{"command": "stats"}
+		{"command": "quit"}
+	Jobs may override epsilon, areaSizeThreshold, colourThreshold and deduplicationEpsilon, the rest comes from the default options.
+	Up to maxJobs jobs run at once, each on a warm EdgeFinder that keeps its buffers, all sharing the worker threads of the pool.
+	The server returns at the end of the input or on quit, after the accepted jobs are done.
+*/
+class JobServer {
+public:
+	JobServer(EdgeFinderOptions const& defaultOptions, ThreadPool& threadPool, int maxJobs, std::ostream& output);
+	~JobServer();
+
+	JobServer(JobServer const&) = delete;
+	JobServer& operator=(JobServer const&) = delete;
+
+	void run(std::istream& input);
+
+	// Live counters: received, completed and failed jobs, queue depth, running jobs and the latency percentiles of the recent jobs
+	QJsonObject getStatistics() const;
+private:
+	struct Job {
+		QJsonValue id;
+		EdgeFinderOptions options;
+		QString imageFile;
+		QByteArray imageData;
+		bool isReturningLines;
+		std::chrono::steady_clock::time_point receivedAt;
+	};
+
+	EdgeFinderOptions const m_defaultOptions;
+	ThreadPool& m_threadPool;
+	int const m_maxJobs;
+	std::ostream& m_output;
+	std::chrono::steady_clock::time_point const m_startedAt;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	std::deque<Job> m_jobs;
+	bool m_isStopping;
+	std::vector<std::thread> m_workers;
+	std::int64_t m_receivedJobCount;
+	std::int64_t m_completedJobCount;
+	std::int64_t m_failedJobCount;
+	int m_runningJobCount;
+	// Latencies of the last jobs from receiving to answering, as a ring buffer
+	std::vector<std::int64_t> m_latencies;
+	std::size_t m_nextLatency;
+
+	std::mutex m_outputMutex;
+
+	bool parseJob(QJsonObject const& request, Job& job, QString& error) const;
+	QJsonObject processJob(Job const& job, EdgeFinder& edgeFinder) const;
+	void workerLoop();
+	void stop();
+	void writeResponse(QJsonObject const& response);
+};
+
+#endif
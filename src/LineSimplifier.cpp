@@ -0,0 +1,88 @@
+#include "LineSimplifier.h"
+
+#include "RamerDouglasPeucker.h"
+#include "SpatialHashGrid.h"
+
+std::vector<std::vector<Point> const*> deduplicateLines(std::vector<std::vector<std::vector<Point>>> const& listOfLinesPerArea, double deduplicationEpsilon) {
+	std::vector<std::vector<Point> const*> keptLines;
+
+	// We will save a single point of each line, and if another line comes closer than a small epsilon, we will consider them identical and remove one.
+	// The marker points are kept in a grid with the epsilon as cell size, so every point only has to be compared against the markers of its neighbouring cells.
+	bool const isDeduplicationEnabled = deduplicationEpsilon > 0.0;
+	SpatialHashGrid deduplicationMarkerPoints(isDeduplicationEnabled ? deduplicationEpsilon : 1.0);
+
+	for (std::size_t i = 0; i < listOfLinesPerArea.size(); ++i) {
+		auto const& lines = listOfLinesPerArea.at(i);
+		for (std::size_t j = 0; j < lines.size(); ++j) {
+			auto const& line = lines.at(j);
+
+			bool isDuplicate = false;
+			if (isDeduplicationEnabled) {
+				for (std::size_t k = 0; (k < line.size()) && (!isDuplicate); ++k) {
+					isDuplicate = deduplicationMarkerPoints.hasPointCloserThan(line.at(k), deduplicationEpsilon);
+				}
+			}
+
+			if (isDuplicate) {
+				continue;
+			}
+			if (isDeduplicationEnabled) {
+				deduplicationMarkerPoints.insert(*line.cbegin());
+			}
+			keptLines.push_back(&line);
+		}
+	}
+	return keptLines;
+}
+
+std::vector<std::vector<Point>> simplifyLines(std::vector<std::vector<Point> const*> const& lines, double epsilon, ThreadPool& threadPool) {
+	// Every line writes its own slot, so the order of the lines does not depend on which thread simplified them.
+	// Short lines are handed out in batches, long ones on their own and split further inside RDP.
+	std::vector<std::vector<Point>> outLines(lines.size());
+	auto const simplifyLine = [&](std::size_t index, ThreadPool* threadPool) {
+		std::vector<Point> const& line = *lines[index];
+		if (line.size() <= 2) {
+			outLines[index] = line;
+		} else if (threadPool != nullptr) {
+			RamerDouglasPeucker(line, epsilon, outLines[index], *threadPool);
+		} else {
+			RamerDouglasPeucker(line, epsilon, outLines[index]);
+		}
+	};
+
+	ThreadPool::TaskGroup rdpTasks;
+	// Runs the short lines in [begin, end), the long ones among them have their own tasks
+	auto const runBatch = [&simplifyLine, &lines, &threadPool, &rdpTasks](std::size_t begin, std::size_t end) {
+		threadPool.run(rdpTasks, [&simplifyLine, &lines, begin, end]() {
+			for (std::size_t j = begin; j < end; ++j) {
+				if (lines[j]->size() <= rdpParallelGrainSize) {
+					simplifyLine(j, nullptr);
+				}
+			}
+		});
+	};
+	std::size_t batchBegin = 0;
+	std::size_t batchLineCount = 0;
+	std::size_t batchPointCount = 0;
+	for (std::size_t i = 0; i < lines.size(); ++i) {
+		if (lines[i]->size() > rdpParallelGrainSize) {
+			threadPool.run(rdpTasks, [&simplifyLine, &threadPool, i]() { simplifyLine(i, &threadPool); });
+			continue;
+		}
+
+		++batchLineCount;
+		batchPointCount += lines[i]->size();
+		if (batchPointCount >= rdpParallelGrainSize) {
+			runBatch(batchBegin, i + 1);
+			batchBegin = i + 1;
+			batchLineCount = 0;
+			batchPointCount = 0;
+		}
+	}
+	// The short lines behind the last full batch, also when long lines follow them
+	if (batchLineCount > 0) {
+		runBatch(batchBegin, lines.size());
+	}
+	threadPool.wait(rdpTasks);
+	return outLines;
+}
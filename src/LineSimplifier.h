@@ -0,0 +1,17 @@
+#ifndef EDGEFINDER_LINESIMPLIFIER_H_
+#define EDGEFINDER_LINESIMPLIFIER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "Point.h"
+#include "ThreadPool.h"
+
+// Keeps a line unless one of its points is closer than deduplicationEpsilon to the first point of an earlier kept line, 0 keeps all lines.
+// Returns the kept lines in order, pointing into listOfLinesPerArea.
+std::vector<std::vector<Point> const*> deduplicateLines(std::vector<std::vector<std::vector<Point>>> const& listOfLinesPerArea, double deduplicationEpsilon);
+
+// Applies RDP to every line on the pool, the simplified lines are in the same order as the input.
+std::vector<std::vector<Point>> simplifyLines(std::vector<std::vector<Point> const*> const& lines, double epsilon, ThreadPool& threadPool);
+
+#endif
@@ -0,0 +1,34 @@
+#include "Log.h"
+
+#include <atomic>
+#include <streambuf>
+
+namespace {
+	std::atomic<LogLevel> currentLogLevel(LogLevel::Normal);
+
+	class NullBuffer : public std::streambuf {
+	protected:
+		int overflow(int c) override {
+			return traits_type::not_eof(c);
+		}
+
+		std::streamsize xsputn(char const*, std::streamsize count) override {
+			return count;
+		}
+	};
+}
+
+void setLogLevel(LogLevel logLevel) {
+	currentLogLevel.store(logLevel);
+}
+
+LogLevel getLogLevel() {
+	return currentLogLevel.load();
+}
+
+std::ostream& logStream(LogLevel logLevel) {
+	// One per thread, as the pipelines of concurrent jobs log at the same time
+	static thread_local NullBuffer nullBuffer;
+	static thread_local std::ostream nullStream(&nullBuffer);
+	return (logLevel <= getLogLevel()) ? std::cout : nullStream;
+}
@@ -0,0 +1,22 @@
+#ifndef EDGEFINDER_LOG_H_
+#define EDGEFINDER_LOG_H_
+
+#include <iostream>
+
+enum class LogLevel {
+	// Only errors, which always go to std::cerr
+	Quiet = 0,
+	// Settings, timings and summaries
+	Normal = 1,
+	// Also the members of every area, which are a lot of lines for noisy images
+	Verbose = 2
+};
+
+void setLogLevel(LogLevel logLevel);
+
+LogLevel getLogLevel();
+
+// std::cout if messages of this level are shown, otherwise a stream that discards everything.
+std::ostream& logStream(LogLevel logLevel);
+
+#endif
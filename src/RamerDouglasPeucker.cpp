@@ -5,8 +5,11 @@
 // Released under CC0
 // https://en.wikipedia.org/wiki/Ramer%E2%80%93Douglas%E2%80%93Peucker_algorithm
 
-#include <iostream>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
 #include <utility>
 #include <vector>
 #include <stdexcept>
@@ -38,43 +41,199 @@ double PerpendicularDistance(const Point& pt, const Point& lineStart, const Poin
 	return pow(pow(ax, 2.0) + pow(ay, 2.0), 0.5);
 }
 
-void RamerDouglasPeucker(std::vector<Point> const& pointList, double epsilon, std::vector<Point>& out) {
-	if (pointList.size() < 2) {
-		throw std::invalid_argument("Not enough points to simplify");
+namespace {
+	// Squared distances this close (relatively) to the maximum or to epsilon are decided by PerpendicularDistance, exactly as before
+	double const ambiguityTolerance = 1e-6;
+
+	struct RdpWorkspace {
+		std::vector<double> xs;
+		std::vector<double> ys;
+		std::vector<double> values;
+		std::vector<std::uint8_t> keep;
+		std::vector<std::pair<std::size_t, std::size_t>> ranges;
+	};
+
+	// Grows once per thread and is then reused, so simplifying does not allocate per call or per subdivision
+	thread_local RdpWorkspace workspace;
+
+	/*
+		Writes a value per point in (first, last) that is ordered like its distance to the line from first to last.
+		That is the squared cross product with the line direction (the squared distance times the squared line length),
+		or the squared distance to the start point if both ends coincide. Branch free over plain arrays, so it vectorises.
+	*/
+	void computeDistanceValues(double const* xs, double const* ys, std::size_t first, std::size_t last, double* values) {
+		double const startX = xs[first];
+		double const startY = ys[first];
+		double const dx = xs[last] - startX;
+		double const dy = ys[last] - startY;
+		if ((dx == 0.0) && (dy == 0.0)) {
+			for (std::size_t i = first + 1; i < last; ++i) {
+				double const pvx = xs[i] - startX;
+				double const pvy = ys[i] - startY;
+				values[i] = pvx * pvx + pvy * pvy;
+			}
+		} else {
+			for (std::size_t i = first + 1; i < last; ++i) {
+				double const cross = dx * (ys[i] - startY) - dy * (xs[i] - startX);
+				values[i] = cross * cross;
+			}
+		}
+	}
+
+	// The original scan over (first, last), returning the farthest point or first if it is not farther than epsilon
+	std::size_t findSplitPointExactly(std::vector<Point> const& pointList, std::size_t first, std::size_t last, double epsilon) {
+		double dmax = 0.0;
+		std::size_t index = first;
+		for (std::size_t i = first + 1; i < last; ++i) {
+			double const d = PerpendicularDistance(pointList[i], pointList[first], pointList[last]);
+			if (d > dmax) {
+				index = i;
+				dmax = d;
+			}
+		}
+		return (dmax > epsilon) ? index : first;
 	}
 
-	// Find the point with the maximum distance from line between start and end
-	double dmax = 0.0;
-	size_t index = 0;
-	size_t end = pointList.size() - 1;
-	for (size_t i = 1; i < end; i++) {
-		double d = PerpendicularDistance(pointList[i], pointList[0], pointList[end]);
-		if (d > dmax) {
-			index = i;
-			dmax = d;
+	// Returns the point in (first, last) the original recursion would split at, or first if the range collapses to its end points
+	std::size_t findSplitPoint(std::vector<Point> const& pointList, double const* xs, double const* ys, double const* values, std::size_t first, std::size_t last, double epsilon) {
+		double maxValue = 0.0;
+		for (std::size_t i = first + 1; i < last; ++i) {
+			maxValue = std::max(maxValue, values[i]);
+		}
+
+		double const dx = xs[last] - xs[first];
+		double const dy = ys[last] - ys[first];
+		double const lineLengthSquared = dx * dx + dy * dy;
+		double const limit = epsilon * epsilon * ((lineLengthSquared > 0.0) ? lineLengthSquared : 1.0);
+		if ((epsilon > 0.0) && (maxValue < limit * (1.0 - ambiguityTolerance))) {
+			return first;
+		} else if ((epsilon < 0.0) || (maxValue <= limit * (1.0 + ambiguityTolerance))) {
+			return findSplitPointExactly(pointList, first, last, epsilon);
+		}
+
+		// Points tied (up to rounding) with the maximum are ranked by the original distance function, first one wins
+		double const candidateValue = maxValue * (1.0 - ambiguityTolerance);
+		std::size_t index = first;
+		std::size_t candidateCount = 0;
+		double dmax = 0.0;
+		for (std::size_t i = first + 1; i < last; ++i) {
+			if (values[i] < candidateValue) {
+				continue;
+			}
+			++candidateCount;
+			if (candidateCount == 1) {
+				index = i;
+				continue;
+			} else if (candidateCount == 2) {
+				dmax = PerpendicularDistance(pointList[index], pointList[first], pointList[last]);
+			}
+			double const d = PerpendicularDistance(pointList[i], pointList[first], pointList[last]);
+			if (d > dmax) {
+				index = i;
+				dmax = d;
+			}
 		}
+		return index;
 	}
 
-	// If max distance is greater than epsilon, recursively simplify
-	if (dmax > epsilon) {
-		// Recursive call
-		std::vector<Point> recResults1;
-		std::vector<Point> recResults2;
-		std::vector<Point> firstLine(pointList.begin(), pointList.begin() + index + 1);
-		std::vector<Point> lastLine(pointList.begin() + index, pointList.end());
-		RamerDouglasPeucker(firstLine, epsilon, recResults1);
-		RamerDouglasPeucker(lastLine, epsilon, recResults2);
-
-		// Build the result list
-		out.assign(recResults1.begin(), recResults1.end() - 1);
-		out.insert(out.end(), recResults2.begin(), recResults2.end());
-		if (out.size() < 2) {
-			throw std::runtime_error("Problem assembling output");
+	// Subdivides the index ranges on the stack until every point between kept points is within epsilon of their line
+	void simplifyRanges(std::vector<Point> const& pointList, double const* xs, double const* ys, double* values, std::uint8_t* keep, std::vector<std::pair<std::size_t, std::size_t>>& ranges, double epsilon) {
+		while (!ranges.empty()) {
+			std::size_t const first = ranges.back().first;
+			std::size_t const last = ranges.back().second;
+			ranges.pop_back();
+			if (last - first < 2) {
+				continue;
+			}
+
+			// Find the point with the maximum distance from line between start and end
+			computeDistanceValues(xs, ys, first, last, values);
+			std::size_t const index = findSplitPoint(pointList, xs, ys, values, first, last, epsilon);
+
+			// If max distance is greater than epsilon, keep it and simplify both halves
+			if (index != first) {
+				keep[index] = 1;
+				ranges.push_back(std::make_pair(first, index));
+				ranges.push_back(std::make_pair(index, last));
+			}
 		}
-	} else {
-		// Just return start and end points
+	}
+
+	void copyKeptPoints(std::vector<Point> const& pointList, std::uint8_t const* keep, std::vector<Point>& out) {
 		out.clear();
-		out.push_back(pointList[0]);
-		out.push_back(pointList[end]);
+		for (std::size_t i = 0; i < pointList.size(); ++i) {
+			if (keep[i]) {
+				out.push_back(pointList[i]);
+			}
+		}
+	}
+}
+
+void RamerDouglasPeucker(std::vector<Point> const& pointList, double epsilon, std::vector<Point>& out) {
+	if (pointList.size() < 2) {
+		throw std::invalid_argument("Not enough points to simplify");
+	}
+
+	// Coordinates as structure of arrays, and a bitmap of the points we keep
+	std::size_t const pointCount = pointList.size();
+	workspace.xs.resize(pointCount);
+	workspace.ys.resize(pointCount);
+	workspace.values.resize(pointCount);
+	for (std::size_t i = 0; i < pointCount; ++i) {
+		workspace.xs[i] = pointList[i].first;
+		workspace.ys[i] = pointList[i].second;
+	}
+	workspace.keep.assign(pointCount, 0);
+	workspace.keep.front() = 1;
+	workspace.keep.back() = 1;
+
+	// Instead of recursing on copies, subdivide index ranges of the original points
+	workspace.ranges.clear();
+	workspace.ranges.push_back(std::make_pair(std::size_t(0), pointCount - 1));
+	simplifyRanges(pointList, workspace.xs.data(), workspace.ys.data(), workspace.values.data(), workspace.keep.data(), workspace.ranges, epsilon);
+
+	copyKeptPoints(pointList, workspace.keep.data(), out);
+}
+
+void RamerDouglasPeucker(std::vector<Point> const& pointList, double epsilon, std::vector<Point>& out, ThreadPool& threadPool) {
+	if ((pointList.size() <= rdpParallelGrainSize) || (threadPool.getThreadCount() < 2)) {
+		RamerDouglasPeucker(pointList, epsilon, out);
+		return;
+	}
+
+	// Shared by all tasks of this line, concurrent ranges only ever touch the points strictly between their ends
+	std::size_t const pointCount = pointList.size();
+	std::vector<double> xs(pointCount);
+	std::vector<double> ys(pointCount);
+	std::vector<double> values(pointCount);
+	for (std::size_t i = 0; i < pointCount; ++i) {
+		xs[i] = pointList[i].first;
+		ys[i] = pointList[i].second;
 	}
+	std::vector<std::uint8_t> keep(pointCount, 0);
+	keep.front() = 1;
+	keep.back() = 1;
+
+	// Split large ranges one level at a time and hand one half to the pool, small ones are finished on the spot
+	ThreadPool::TaskGroup taskGroup;
+	std::function<void(std::size_t, std::size_t)> simplifyRange = [&](std::size_t first, std::size_t last) {
+		while (last - first > rdpParallelGrainSize) {
+			computeDistanceValues(xs.data(), ys.data(), first, last, values.data());
+			std::size_t const index = findSplitPoint(pointList, xs.data(), ys.data(), values.data(), first, last, epsilon);
+			if (index == first) {
+				return;
+			}
+			keep[index] = 1;
+			threadPool.run(taskGroup, [&simplifyRange, first, index]() { simplifyRange(first, index); });
+			first = index;
+		}
+
+		workspace.ranges.clear();
+		workspace.ranges.push_back(std::make_pair(first, last));
+		simplifyRanges(pointList, xs.data(), ys.data(), values.data(), keep.data(), workspace.ranges, epsilon);
+	};
+	simplifyRange(0, pointCount - 1);
+	threadPool.wait(taskGroup);
+
+	copyKeptPoints(pointList, keep.data(), out);
 }
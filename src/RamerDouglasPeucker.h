@@ -5,7 +5,14 @@
 #include <vector>
 
 #include "Point.h"
+#include "ThreadPool.h"
+
+// Lines with more points than this are split into tasks by the parallel variant
+std::size_t const rdpParallelGrainSize = 16384;
 
 void RamerDouglasPeucker(std::vector<Point> const& pointList, double epsilon, std::vector<Point>& out);
 
+// Same result as above, large subranges of the line are simplified as tasks on the pool.
+void RamerDouglasPeucker(std::vector<Point> const& pointList, double epsilon, std::vector<Point>& out, ThreadPool& threadPool);
+
 #endif
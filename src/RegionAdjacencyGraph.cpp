@@ -0,0 +1,174 @@
+#include "RegionAdjacencyGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <queue>
+#include <utility>
+
+RegionAdjacencyGraph::RegionAdjacencyGraph(AreaInformation const& areaInformation) : m_areaUnionFind(), m_areaSizes(), m_neighbourOffsets(), m_neighbours(), m_nextMember() {
+	int const areaCount = areaInformation.getAreaCount();
+	m_areaUnionFind.reserve(areaCount);
+	m_areaSizes.reserve(areaCount);
+	for (int area = 0; area < areaCount; ++area) {
+		m_areaUnionFind.addArea();
+		m_areaSizes.push_back(areaInformation.getAreaMemberCount(area));
+	}
+
+	// AreaInformation only records the neighbours above and left of an area, so both directions are added here
+	std::vector<std::pair<int, int>> const& recordedEdges = areaInformation.getNeighbourEdges();
+	std::vector<std::pair<int, int>> edges;
+	edges.reserve(2 * recordedEdges.size());
+	for (auto it = recordedEdges.cbegin(); it != recordedEdges.cend(); ++it) {
+		int const area = areaInformation.resolveArea(it->first);
+		int const neighbour = areaInformation.resolveArea(it->second);
+		if (neighbour != area) {
+			edges.push_back(std::make_pair(area, neighbour));
+			edges.push_back(std::make_pair(neighbour, area));
+		}
+	}
+	setNeighbours(edges);
+}
+
+RegionAdjacencyGraph::RegionAdjacencyGraph(std::vector<int> const& areaSizes, std::vector<std::pair<int, int>> edges) : m_areaUnionFind(), m_areaSizes(areaSizes), m_neighbourOffsets(), m_neighbours(), m_nextMember() {
+	m_areaUnionFind.reserve(areaSizes.size());
+	for (std::size_t i = 0; i < areaSizes.size(); ++i) {
+		m_areaUnionFind.addArea();
+	}
+
+	std::size_t const edgeCount = edges.size();
+	edges.reserve(2 * edgeCount);
+	for (std::size_t i = 0; i < edgeCount; ++i) {
+		edges.push_back(std::make_pair(edges[i].second, edges[i].first));
+	}
+	edges.erase(std::remove_if(edges.begin(), edges.end(), [](std::pair<int, int> const& edge) { return edge.first == edge.second; }), edges.end());
+	setNeighbours(edges);
+}
+
+void RegionAdjacencyGraph::setNeighbours(std::vector<std::pair<int, int>> const& edges) {
+	int const areaCount = getAreaCount();
+
+	// Counting sort by area, then every row is sorted and deduplicated on its own
+	std::vector<int> rowStarts(areaCount + 1, 0);
+	for (auto it = edges.cbegin(); it != edges.cend(); ++it) {
+		++rowStarts[it->first + 1];
+	}
+	std::partial_sum(rowStarts.begin(), rowStarts.end(), rowStarts.begin());
+	std::vector<int> neighbours(edges.size());
+	std::vector<int> rowEnds(rowStarts.begin(), rowStarts.end() - 1);
+	for (auto it = edges.cbegin(); it != edges.cend(); ++it) {
+		neighbours[rowEnds[it->first]++] = it->second;
+	}
+
+	m_neighbourOffsets.assign(areaCount + 1, 0);
+	m_neighbours.clear();
+	m_neighbours.reserve(neighbours.size());
+	for (int area = 0; area < areaCount; ++area) {
+		auto const rowBegin = neighbours.begin() + rowStarts[area];
+		auto const rowEnd = neighbours.begin() + rowStarts[area + 1];
+		std::sort(rowBegin, rowEnd);
+		m_neighbours.insert(m_neighbours.end(), rowBegin, std::unique(rowBegin, rowEnd));
+		m_neighbourOffsets[area + 1] = static_cast<int>(m_neighbours.size());
+	}
+
+	m_nextMember.resize(areaCount);
+	std::iota(m_nextMember.begin(), m_nextMember.end(), 0);
+}
+
+int RegionAdjacencyGraph::getAreaCount() const {
+	return static_cast<int>(m_areaSizes.size());
+}
+
+int RegionAdjacencyGraph::getAreaSize(int area) const {
+	return m_areaSizes.at(m_areaUnionFind.find(area));
+}
+
+int RegionAdjacencyGraph::resolveArea(int area) const {
+	return m_areaUnionFind.find(area);
+}
+
+int RegionAdjacencyGraph::getLargestNeighbourArea(int area) const {
+	int const root = m_areaUnionFind.find(area);
+
+	// Neighbour ids may have been absorbed meanwhile, so resolve them and skip ourselves while searching
+	int largestNeighbourAreaId = -1;
+	int largestNeighbourSize = -1;
+	int member = root;
+	do {
+		for (int i = m_neighbourOffsets[member]; i < m_neighbourOffsets[member + 1]; ++i) {
+			int const neighbour = m_areaUnionFind.find(m_neighbours[i]);
+			if (neighbour == root) {
+				continue;
+			}
+			int const neighbourSize = m_areaSizes[neighbour];
+			if ((neighbourSize > largestNeighbourSize) || ((neighbourSize == largestNeighbourSize) && (neighbour < largestNeighbourAreaId))) {
+				largestNeighbourSize = neighbourSize;
+				largestNeighbourAreaId = neighbour;
+			}
+		}
+		member = m_nextMember[member];
+	} while (member != root);
+	return largestNeighbourAreaId;
+}
+
+int RegionAdjacencyGraph::absorbArea(int area, int intoArea) {
+	int const areaRoot = m_areaUnionFind.find(area);
+	int const intoRoot = m_areaUnionFind.find(intoArea);
+	assert(areaRoot != intoRoot && "Internal Error: Can not absorb an area into itself!");
+
+	int const survivor = m_areaUnionFind.unite(areaRoot, intoRoot);
+	int const absorbed = (survivor == areaRoot) ? intoRoot : areaRoot;
+	m_areaSizes[survivor] += m_areaSizes[absorbed];
+	m_areaSizes[absorbed] = 0;
+
+	// Swapping the successors of one member of each circle joins them into one
+	std::swap(m_nextMember[survivor], m_nextMember[absorbed]);
+
+	return survivor;
+}
+
+std::size_t RegionAdjacencyGraph::absorbSmallAreas(int areaSizeThreshold, AreaInformation& areaInformation) {
+	return absorbSmallAreas(areaSizeThreshold, [&areaInformation](int area, int intoArea) {
+		areaInformation.mergeAreas(area, intoArea);
+	});
+}
+
+std::size_t RegionAdjacencyGraph::absorbSmallAreas(int areaSizeThreshold) {
+	return absorbSmallAreas(areaSizeThreshold, [](int, int) {});
+}
+
+std::size_t RegionAdjacencyGraph::absorbSmallAreas(int areaSizeThreshold, std::function<void(int, int)> const& onAbsorb) {
+	typedef std::pair<int, int> SizeAndArea;
+	std::priority_queue<SizeAndArea, std::vector<SizeAndArea>, std::greater<SizeAndArea>> smallAreas;
+	for (int area = 0; area < getAreaCount(); ++area) {
+		if (m_areaSizes[area] < areaSizeThreshold) {
+			smallAreas.push(std::make_pair(m_areaSizes[area], area));
+		}
+	}
+
+	std::size_t absorbedAreas = 0;
+	while (!smallAreas.empty()) {
+		SizeAndArea const smallest = smallAreas.top();
+		smallAreas.pop();
+
+		// Entries are not updated in place, skip the ones that were absorbed or have grown since
+		int const area = smallest.second;
+		if ((m_areaUnionFind.find(area) != area) || (m_areaSizes[area] != smallest.first)) {
+			continue;
+		}
+
+		int const newArea = getLargestNeighbourArea(area);
+		if (newArea == -1) {
+			// The area covers the whole image, there is nothing to merge into
+			continue;
+		}
+
+		int const survivor = absorbArea(area, newArea);
+		onAbsorb(area, newArea);
+		++absorbedAreas;
+		if (m_areaSizes[survivor] < areaSizeThreshold) {
+			smallAreas.push(std::make_pair(m_areaSizes[survivor], survivor));
+		}
+	}
+	return absorbedAreas;
+}
@@ -0,0 +1,56 @@
+#ifndef EDGEFINDER_REGIONADJACENCYGRAPH_H_
+#define EDGEFINDER_REGIONADJACENCYGRAPH_H_
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "AreaInformation.h"
+#include "AreaUnionFind.h"
+
+/*
+	Undirected adjacency between the areas of a packed AreaInformation, together with their sizes.
+	The neighbours are kept as compressed sparse rows, one sorted row per area, built once from the flat edge list of the labelling.
+	Areas can be absorbed into neighbours, which updates sizes and membership incrementally instead of re-scanning the image.
+*/
+class RegionAdjacencyGraph {
+public:
+	explicit RegionAdjacencyGraph(AreaInformation const& areaInformation);
+
+	// From the size of every area and pairs of adjacent areas, in any order and direction and possibly repeated.
+	RegionAdjacencyGraph(std::vector<int> const& areaSizes, std::vector<std::pair<int, int>> edges);
+
+	int getAreaCount() const;
+
+	int getAreaSize(int area) const;
+
+	// The area that area was absorbed into, or area itself.
+	int resolveArea(int area) const;
+
+	// The neighbour with the most members, ties go to the lower id. -1 if the area has no neighbours.
+	// Walks the rows of every area absorbed into area so far, which stays cheap as only small areas are asked for.
+	int getLargestNeighbourArea(int area) const;
+
+	// Repeatedly absorbs the smallest area below areaSizeThreshold into its largest neighbour until none is left.
+	// Every absorption is mirrored into areaInformation via mergeAreas(), which then only needs a single packAreas().
+	// Returns the number of absorbed areas.
+	std::size_t absorbSmallAreas(int areaSizeThreshold, AreaInformation& areaInformation);
+
+	// Same, for callers without labels that resolve areas through resolveArea() afterwards.
+	std::size_t absorbSmallAreas(int areaSizeThreshold);
+private:
+	AreaUnionFind m_areaUnionFind;
+	std::vector<int> m_areaSizes;
+	// The neighbours of area i are m_neighbours[m_neighbourOffsets[i]] up to m_neighbours[m_neighbourOffsets[i + 1]], as labelled before any absorption
+	std::vector<int> m_neighbourOffsets;
+	std::vector<int> m_neighbours;
+	// Circular list through the areas absorbed into each other, so every root reaches the rows of all its members
+	std::vector<int> m_nextMember;
+
+	void setNeighbours(std::vector<std::pair<int, int>> const& edges);
+	int absorbArea(int area, int intoArea);
+	std::size_t absorbSmallAreas(int areaSizeThreshold, std::function<void(int, int)> const& onAbsorb);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "SpatialHashGrid.h"
+
+#include <cassert>
+
+SpatialHashGrid::SpatialHashGrid(double cellSize) : m_cellSize(cellSize), m_pointCount(0), m_cells() {
+	assert(cellSize > 0.0 && "Internal Error: Cell size has to be positive!");
+}
+
+void SpatialHashGrid::insert(Point const& point) {
+	m_cells[cellKey(toCell(point.first), toCell(point.second))].push_back(point);
+	++m_pointCount;
+}
+
+bool SpatialHashGrid::hasPointCloserThan(Point const& point, double distance) const {
+	assert(distance <= m_cellSize && "Internal Error: Query distance exceeds the cell size!");
+	if (m_pointCount == 0) {
+		return false;
+	}
+
+	double const squaredDistance = distance * distance;
+	std::int64_t const cellX = toCell(point.first);
+	std::int64_t const cellY = toCell(point.second);
+	for (std::int64_t y = cellY - 1; y <= cellY + 1; ++y) {
+		for (std::int64_t x = cellX - 1; x <= cellX + 1; ++x) {
+			auto const it = m_cells.find(cellKey(x, y));
+			if (it == m_cells.cend()) {
+				continue;
+			}
+			for (auto pointIt = it->second.cbegin(); pointIt != it->second.cend(); ++pointIt) {
+				double const d_x = pointIt->first - point.first;
+				double const d_y = pointIt->second - point.second;
+				if (d_x * d_x + d_y * d_y < squaredDistance) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+std::size_t SpatialHashGrid::getPointCount() const {
+	return m_pointCount;
+}
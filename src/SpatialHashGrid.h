@@ -0,0 +1,39 @@
+#ifndef EDGEFINDER_SPATIALHASHGRID_H_
+#define EDGEFINDER_SPATIALHASHGRID_H_
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Point.h"
+
+/*
+	Uniform grid over the plane, hashed by cell coordinates, for "is any stored point close to this one" queries.
+	With distances up to the cell size, a query only has to look at the 3x3 cells around the query point.
+*/
+class SpatialHashGrid {
+public:
+	explicit SpatialHashGrid(double cellSize);
+
+	void insert(Point const& point);
+
+	// True if a stored point is strictly closer than distance to point, which must not exceed the cell size.
+	bool hasPointCloserThan(Point const& point, double distance) const;
+
+	std::size_t getPointCount() const;
+private:
+	double const m_cellSize;
+	std::size_t m_pointCount;
+	std::unordered_map<std::uint64_t, std::vector<Point>> m_cells;
+
+	inline std::int64_t toCell(PointType coordinate) const {
+		return static_cast<std::int64_t>(std::floor(coordinate / m_cellSize));
+	}
+
+	static inline std::uint64_t cellKey(std::int64_t cellX, std::int64_t cellY) {
+		return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cellX)) << 32) | static_cast<std::uint32_t>(cellY);
+	}
+};
+
+#endif
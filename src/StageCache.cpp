@@ -0,0 +1,260 @@
+#include "StageCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <QCryptographicHash>
+#include <QSaveFile>
+
+namespace {
+	char const fileMagic[4] = { 'E', 'F', 'S', 'C' };
+	// Increase whenever the layout of a stage or its meaning changes, older files are then ignored
+	std::uint32_t const fileVersion = 2;
+
+	template<typename T>
+	QByteArray asBytes(std::vector<T> const& values) {
+		return QByteArray::fromRawData(reinterpret_cast<char const*>(values.data()), static_cast<int>(values.size() * sizeof(T)));
+	}
+
+	// Whether every label names one of the areas, anything else would index past their member counts
+	template<typename Label>
+	bool areLabelsValid(Label const* labels, std::uint64_t pixelCount, std::uint64_t areaCount) {
+		return std::all_of(labels, labels + pixelCount, [areaCount](Label label) { return (label >= 0) && (static_cast<std::uint64_t>(label) < areaCount); });
+	}
+
+	QString getLineFormerName(LineFormerType lineFormerType) {
+		return (lineFormerType == LineFormerType::Contour) ? "contour" : "points";
+	}
+}
+
+StageCache::StageCache(QString const& directory) : m_directory(directory) {
+	//
+}
+
+bool StageCache::isUsable() const {
+	return m_directory.mkpath(".");
+}
+
+QString StageCache::getDirectory() const {
+	return m_directory.path();
+}
+
+QByteArray StageCache::hashImage(ImageView const& image) {
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	std::int32_t const size[2] = { image.width, image.height };
+	hash.addData(QByteArray::fromRawData(reinterpret_cast<char const*>(size), sizeof(size)));
+	// Row by row, as the padding at the end of the rows is undefined. Always as RGB32, so the key does not depend on the pixel format.
+	int const rowBytes = image.width * 4;
+	std::vector<std::uint32_t> rgbRow(image.width);
+	for (int y = 0; y < image.height; ++y) {
+		hash.addData(QByteArray::fromRawData(reinterpret_cast<char const*>(getRgb32Row(image, y, rgbRow.data())), rowBytes));
+	}
+	return hash.result().toHex();
+}
+
+bool StageCache::loadMask(QByteArray const& imageHash, int colourThreshold, BitMask& mask) const {
+	QFile file(getFileName(imageHash, "mask_c" + QString::number(colourThreshold)));
+	FileHeader header;
+	std::uint64_t payloadSize = 0;
+	uchar const* const payload = mapPayload(file, StageType::Mask, header, payloadSize);
+	std::size_t const wordCount = static_cast<std::size_t>(mask.getWordsPerRow()) * mask.getHeight();
+	if ((payload == nullptr) || (header.width != mask.getWidth()) || (header.height != mask.getHeight()) || (payloadSize != wordCount * sizeof(std::uint64_t))) {
+		return false;
+	}
+	if (wordCount > 0) {
+		std::memcpy(mask.getRow(0), payload, payloadSize);
+	}
+	return true;
+}
+
+bool StageCache::storeMask(QByteArray const& imageHash, int colourThreshold, BitMask const& mask) const {
+	FileHeader header = makeHeader(StageType::Mask, mask.getWidth(), mask.getHeight());
+	header.values[0] = mask.getWordsPerRow();
+	std::size_t const wordCount = static_cast<std::size_t>(mask.getWordsPerRow()) * mask.getHeight();
+	QByteArray const words = (wordCount > 0) ? QByteArray::fromRawData(reinterpret_cast<char const*>(mask.getRow(0)), static_cast<int>(wordCount * sizeof(std::uint64_t))) : QByteArray();
+	return writeFile(getFileName(imageHash, "mask_c" + QString::number(colourThreshold)), header, { words });
+}
+
+bool StageCache::loadAreas(QByteArray const& imageHash, int colourThreshold, int areaSizeThreshold, AreaInformation& areas, EdgeFinderStatistics& statistics) const {
+	QFile file(getFileName(imageHash, "areas_c" + QString::number(colourThreshold) + "_a" + QString::number(areaSizeThreshold)));
+	FileHeader header;
+	std::uint64_t payloadSize = 0;
+	uchar const* const payload = mapPayload(file, StageType::Areas, header, payloadSize);
+	if (payload == nullptr) {
+		return false;
+	}
+	std::uint64_t const areaCount = header.values[0];
+	std::uint64_t const pixelCount = static_cast<std::uint64_t>(header.width) * header.height;
+	bool const isNarrow = (header.labelSize == sizeof(std::uint16_t));
+	if (((header.labelSize != sizeof(std::uint16_t)) && (header.labelSize != sizeof(std::int32_t))) || (payloadSize != areaCount * sizeof(std::int32_t) + pixelCount * header.labelSize)) {
+		return false;
+	}
+
+	if (areaCount > static_cast<std::uint64_t>(std::numeric_limits<int>::max())) {
+		return false;
+	}
+
+	// Payload: the member count of every area, then the labels row by row in the width they were packed to
+	std::vector<int> memberCounts(areaCount);
+	std::memcpy(memberCounts.data(), payload, areaCount * sizeof(std::int32_t));
+	uchar const* const labels = payload + areaCount * sizeof(std::int32_t);
+	bool const isValid = std::all_of(memberCounts.begin(), memberCounts.end(), [](int memberCount) { return memberCount >= 0; })
+		&& (isNarrow ? areLabelsValid(reinterpret_cast<std::uint16_t const*>(labels), pixelCount, areaCount) : areLabelsValid(reinterpret_cast<std::int32_t const*>(labels), pixelCount, areaCount));
+	if (!isValid) {
+		return false;
+	}
+	if (isNarrow) {
+		areas = AreaInformation::fromPackedLabels(header.width, header.height, memberCounts, reinterpret_cast<std::uint16_t const*>(labels));
+	} else {
+		areas = AreaInformation::fromPackedLabels(header.width, header.height, memberCounts, reinterpret_cast<std::int32_t const*>(labels));
+	}
+	statistics.labelledAreaCount = static_cast<int>(header.values[1]);
+	statistics.connectedAreaCount = static_cast<int>(header.values[2]);
+	statistics.absorbedAreaCount = header.values[3];
+	return true;
+}
+
+bool StageCache::storeAreas(QByteArray const& imageHash, int colourThreshold, int areaSizeThreshold, AreaInformation const& areas, EdgeFinderStatistics const& statistics) const {
+	FileHeader header = makeHeader(StageType::Areas, areas.getWidth(), areas.getHeight());
+	header.values[0] = areas.getAreaCount();
+	header.values[1] = statistics.labelledAreaCount;
+	header.values[2] = statistics.connectedAreaCount;
+	header.values[3] = statistics.absorbedAreaCount;
+
+	std::vector<std::int32_t> memberCounts;
+	memberCounts.reserve(areas.getAreaCount());
+	for (int i = 0; i < areas.getAreaCount(); ++i) {
+		memberCounts.push_back(areas.getAreaMemberCount(i));
+	}
+	std::size_t const pixelCount = static_cast<std::size_t>(areas.getWidth()) * areas.getHeight();
+	header.labelSize = areas.hasNarrowLabels() ? sizeof(std::uint16_t) : sizeof(std::int32_t);
+	char const* const labelData = areas.hasNarrowLabels() ? reinterpret_cast<char const*>(areas.getNarrowAreaRow(0)) : reinterpret_cast<char const*>(areas.getAreaRow(0));
+	QByteArray const labels = (pixelCount > 0) ? QByteArray::fromRawData(labelData, static_cast<int>(pixelCount * header.labelSize)) : QByteArray();
+	return writeFile(getFileName(imageHash, "areas_c" + QString::number(colourThreshold) + "_a" + QString::number(areaSizeThreshold)), header, { asBytes(memberCounts), labels });
+}
+
+bool StageCache::loadLines(QByteArray const& imageHash, int colourThreshold, int areaSizeThreshold, LineFormerType lineFormerType, std::vector<std::vector<std::vector<Point>>>& listOfLinesPerArea, EdgeFinderStatistics& statistics) const {
+	QFile file(getFileName(imageHash, "lines_c" + QString::number(colourThreshold) + "_a" + QString::number(areaSizeThreshold) + "_" + getLineFormerName(lineFormerType)));
+	FileHeader header;
+	std::uint64_t payloadSize = 0;
+	uchar const* const payload = mapPayload(file, StageType::Lines, header, payloadSize);
+	if (payload == nullptr) {
+		return false;
+	}
+	std::uint64_t const areaCount = header.values[0];
+	std::uint64_t const lineCount = header.values[1];
+	std::uint64_t const pointCount = header.values[2];
+	if (payloadSize != (areaCount + lineCount) * sizeof(std::uint32_t) + pointCount * 2 * sizeof(PointType)) {
+		return false;
+	}
+
+	// Payload: the line count of every area, the point count of every line, then the coordinates of all points
+	std::uint32_t const* const lineCounts = reinterpret_cast<std::uint32_t const*>(payload);
+	std::uint32_t const* const pointCounts = lineCounts + areaCount;
+	uchar const* const coordinates = payload + (areaCount + lineCount) * sizeof(std::uint32_t);
+	std::uint64_t lineIndex = 0;
+	std::uint64_t pointIndex = 0;
+	listOfLinesPerArea.assign(areaCount, {});
+	for (std::uint64_t area = 0; area < areaCount; ++area) {
+		if (lineIndex + lineCounts[area] > lineCount) {
+			return false;
+		}
+		auto& lines = listOfLinesPerArea[area];
+		lines.resize(lineCounts[area]);
+		for (auto& line : lines) {
+			std::uint32_t const linePointCount = pointCounts[lineIndex++];
+			if (pointIndex + linePointCount > pointCount) {
+				return false;
+			}
+			line.resize(linePointCount);
+			for (auto& point : line) {
+				PointType xy[2];
+				std::memcpy(xy, coordinates + pointIndex * sizeof(xy), sizeof(xy));
+				point = std::make_pair(xy[0], xy[1]);
+				++pointIndex;
+			}
+		}
+	}
+	statistics.maxStackSize = header.values[3];
+	return (lineIndex == lineCount) && (pointIndex == pointCount);
+}
+
+bool StageCache::storeLines(QByteArray const& imageHash, int colourThreshold, int areaSizeThreshold, LineFormerType lineFormerType, std::vector<std::vector<std::vector<Point>>> const& listOfLinesPerArea, EdgeFinderStatistics const& statistics) const {
+	std::vector<std::uint32_t> lineCounts;
+	std::vector<std::uint32_t> pointCounts;
+	std::vector<PointType> coordinates;
+	lineCounts.reserve(listOfLinesPerArea.size());
+	for (auto const& lines : listOfLinesPerArea) {
+		lineCounts.push_back(static_cast<std::uint32_t>(lines.size()));
+		for (auto const& line : lines) {
+			pointCounts.push_back(static_cast<std::uint32_t>(line.size()));
+			for (auto const& point : line) {
+				coordinates.push_back(point.first);
+				coordinates.push_back(point.second);
+			}
+		}
+	}
+
+	FileHeader header = makeHeader(StageType::Lines, 0, 0);
+	header.values[0] = lineCounts.size();
+	header.values[1] = pointCounts.size();
+	header.values[2] = coordinates.size() / 2;
+	header.values[3] = statistics.maxStackSize;
+	return writeFile(getFileName(imageHash, "lines_c" + QString::number(colourThreshold) + "_a" + QString::number(areaSizeThreshold) + "_" + getLineFormerName(lineFormerType)), header, { asBytes(lineCounts), asBytes(pointCounts), asBytes(coordinates) });
+}
+
+QString StageCache::getFileName(QByteArray const& imageHash, QString const& stageKey) const {
+	return m_directory.filePath(QString::fromLatin1(imageHash) + "_" + stageKey + ".efc");
+}
+
+bool StageCache::writeFile(QString const& fileName, FileHeader const& header, std::vector<QByteArray> const& payload) const {
+	// Readers never see a partly written file, it replaces the old one on commit
+	QSaveFile file(fileName);
+	if (!file.open(QFile::WriteOnly)) {
+		return false;
+	}
+	if (file.write(reinterpret_cast<char const*>(&header), sizeof(header)) != sizeof(header)) {
+		file.cancelWriting();
+		return false;
+	}
+	for (auto const& part : payload) {
+		if (file.write(part) != part.size()) {
+			file.cancelWriting();
+			return false;
+		}
+	}
+	return file.commit();
+}
+
+StageCache::FileHeader StageCache::makeHeader(StageType stageType, int width, int height) {
+	FileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+	header.version = fileVersion;
+	header.stageType = stageType;
+	header.width = width;
+	header.height = height;
+	return header;
+}
+
+uchar const* StageCache::mapPayload(QFile& file, StageType stageType, FileHeader& header, std::uint64_t& payloadSize) {
+	if (!file.open(QFile::ReadOnly)) {
+		return nullptr;
+	}
+	qint64 const fileSize = file.size();
+	if (fileSize < static_cast<qint64>(sizeof(FileHeader))) {
+		return nullptr;
+	}
+	// Stays mapped until the file is closed
+	uchar const* const data = file.map(0, fileSize);
+	if (data == nullptr) {
+		return nullptr;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if ((std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0) || (header.version != fileVersion) || (header.stageType != stageType) || (header.width < 0) || (header.height < 0)) {
+		return nullptr;
+	}
+	payloadSize = static_cast<std::uint64_t>(fileSize) - sizeof(FileHeader);
+	return data + sizeof(FileHeader);
+}
@@ -0,0 +1,78 @@
+#ifndef EDGEFINDER_STAGECACHE_H_
+#define EDGEFINDER_STAGECACHE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QString>
+
+#include "AreaInformation.h"
+#include "BitMask.h"
+#include "ContourTracer.h"
+#include "EdgeFinder.h"
+#include "Point.h"
+
+/*
+	Keeps the results of the expensive stages in a directory, one binary file per stage, image and the parameters the stage depends on:
+		<image hash>_mask_c<colourThreshold>.efc
+		<image hash>_areas_c<colourThreshold>_a<areaSizeThreshold>.efc
+		<image hash>_lines_c<colourThreshold>_a<areaSizeThreshold>_<lineFormer>.efc
+	The image hash covers the decoded pixels, so the same artwork in another file or format hits the same entries.
+	The mask and the areas have the size of the crop they were made from, so entries written with cropping switched the other way are misses.
+	Files are written atomically and memory mapped for loading. Anything that does not match the expected layout is treated as a miss.
+*/
+class StageCache {
+public:
+	explicit StageCache(QString const& directory);
+
+	// Creates the directory if needed, returns false if that failed
+	bool isUsable() const;
+
+	QString getDirectory() const;
+
+	static QByteArray hashImage(ImageView const& image);
+
+	// mask has to have the size of the image
+	bool loadMask(QByteArray const& imageHash, int colourThreshold, BitMask& mask) const;
+	bool storeMask(QByteArray const& imageHash, int colourThreshold, BitMask const& mask) const;
+
+	// The packed areas after small area merging, with the area counts of the statistics. The labels keep the width they were packed to.
+	bool loadAreas(QByteArray const& imageHash, int colourThreshold, int areaSizeThreshold, AreaInformation& areas, EdgeFinderStatistics& statistics) const;
+	bool storeAreas(QByteArray const& imageHash, int colourThreshold, int areaSizeThreshold, AreaInformation const& areas, EdgeFinderStatistics const& statistics) const;
+
+	// The lines per area before deduplication, with the maximum stack size of the statistics
+	bool loadLines(QByteArray const& imageHash, int colourThreshold, int areaSizeThreshold, LineFormerType lineFormerType, std::vector<std::vector<std::vector<Point>>>& listOfLinesPerArea, EdgeFinderStatistics& statistics) const;
+	bool storeLines(QByteArray const& imageHash, int colourThreshold, int areaSizeThreshold, LineFormerType lineFormerType, std::vector<std::vector<std::vector<Point>>> const& listOfLinesPerArea, EdgeFinderStatistics const& statistics) const;
+private:
+	enum class StageType : std::uint32_t {
+		Mask = 1,
+		Areas = 2,
+		Lines = 3
+	};
+
+	// Every file starts with this, followed by the payload of the stage
+	struct FileHeader {
+		char magic[4];
+		std::uint32_t version;
+		StageType stageType;
+		std::int32_t width;
+		std::int32_t height;
+		// Bytes per label of the areas, 0 for the other stages
+		std::uint32_t labelSize;
+		// Stage specific sizes and statistics
+		std::uint64_t values[4];
+	};
+
+	QDir m_directory;
+
+	QString getFileName(QByteArray const& imageHash, QString const& stageKey) const;
+	bool writeFile(QString const& fileName, FileHeader const& header, std::vector<QByteArray> const& payload) const;
+	static FileHeader makeHeader(StageType stageType, int width, int height);
+	// Maps the file and checks its header, returns the payload behind it or nullptr if the file is missing or of another stage or version
+	static uchar const* mapPayload(QFile& file, StageType stageType, FileHeader& header, std::uint64_t& payloadSize);
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "StageProfiler.h"
+
+#include <cassert>
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+StageProfiler::StageProfiler() : m_images(), m_isStageRunning(false), m_stageWallStart(), m_stageCpuStart(0) {
+	//
+}
+
+void StageProfiler::beginImage(QString const& fileName, int width, int height) {
+	assert(!m_isStageRunning && "Internal Error: Began an image while a stage was running!");
+	m_images.push_back({ fileName, width, height, {} });
+}
+
+void StageProfiler::beginStage(std::string const& name) {
+	assert(!m_isStageRunning && "Internal Error: Began a stage while another one was running!");
+	if (m_images.empty()) {
+		beginImage(QString(), 0, 0);
+	}
+	m_images.back().stages.push_back({ name, 0, 0, 0, {} });
+	m_isStageRunning = true;
+	m_stageCpuStart = getProcessCpuMicroseconds();
+	m_stageWallStart = std::chrono::steady_clock::now();
+}
+
+StageProfiler::Stage const& StageProfiler::endStage() {
+	auto const stageWallEnd = std::chrono::steady_clock::now();
+	assert(m_isStageRunning && "Internal Error: Ended a stage that was not running!");
+	Stage& stage = getCurrentStage();
+	stage.wallMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(stageWallEnd - m_stageWallStart).count();
+	stage.cpuMicroseconds = getProcessCpuMicroseconds() - m_stageCpuStart;
+	stage.peakRssKilobytes = getPeakRssKilobytes();
+	m_isStageRunning = false;
+	return stage;
+}
+
+void StageProfiler::addCounter(std::string const& name, std::int64_t value) {
+	getCurrentStage().counters.push_back(std::make_pair(name, value));
+}
+
+StageProfiler::Stage& StageProfiler::getCurrentStage() {
+	assert(!m_images.empty() && !m_images.back().stages.empty() && "Internal Error: No stage was begun yet!");
+	return m_images.back().stages.back();
+}
+
+bool StageProfiler::writeJson(QString const& fileName) const {
+	QJsonArray images;
+	for (auto const& image : m_images) {
+		QJsonArray stages;
+		for (auto const& stage : image.stages) {
+			QJsonObject counters;
+			for (auto const& counter : stage.counters) {
+				counters.insert(QString::fromStdString(counter.first), static_cast<qint64>(counter.second));
+			}
+			QJsonObject stageObject;
+			stageObject.insert("name", QString::fromStdString(stage.name));
+			stageObject.insert("wallMicroseconds", static_cast<qint64>(stage.wallMicroseconds));
+			stageObject.insert("cpuMicroseconds", static_cast<qint64>(stage.cpuMicroseconds));
+			stageObject.insert("peakRssKilobytes", static_cast<qint64>(stage.peakRssKilobytes));
+			stageObject.insert("counters", counters);
+			stages.append(stageObject);
+		}
+		QJsonObject imageObject;
+		imageObject.insert("file", image.fileName);
+		imageObject.insert("width", image.width);
+		imageObject.insert("height", image.height);
+		imageObject.insert("stages", stages);
+		images.append(imageObject);
+	}
+	QJsonObject report;
+	report.insert("images", images);
+	report.insert("peakRssKilobytes", static_cast<qint64>(getPeakRssKilobytes()));
+
+	QFile file(fileName);
+	if (!file.open(QFile::WriteOnly)) {
+		return false;
+	}
+	QByteArray const json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+	return file.write(json) == json.size();
+}
+
+std::int64_t StageProfiler::getProcessCpuMicroseconds() {
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernelTime.dwLowDateTime;
+	kernel.HighPart = kernelTime.dwHighDateTime;
+	user.LowPart = userTime.dwLowDateTime;
+	user.HighPart = userTime.dwHighDateTime;
+	return static_cast<std::int64_t>(kernel.QuadPart + user.QuadPart) / 10;
+#else
+	timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return static_cast<std::int64_t>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+#endif
+}
+
+std::int64_t StageProfiler::getPeakRssKilobytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return static_cast<std::int64_t>(counters.PeakWorkingSetSize / 1024);
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	// In bytes on macOS
+	return static_cast<std::int64_t>(usage.ru_maxrss / 1024);
+#else
+	return static_cast<std::int64_t>(usage.ru_maxrss);
+#endif
+#endif
+}
@@ -0,0 +1,67 @@
+#ifndef EDGEFINDER_STAGEPROFILER_H_
+#define EDGEFINDER_STAGEPROFILER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <QString>
+
+/*
+	Records wall time, CPU time of the whole process (all threads), peak RSS and named counters for every stage of the pipeline, per image.
+	Stages are started and ended explicitly like the timing pairs they replace, so callers can still print their own timing lines.
+	The report is written as JSON.
+*/
+class StageProfiler {
+public:
+	struct Stage {
+		std::string name;
+		std::int64_t wallMicroseconds;
+		std::int64_t cpuMicroseconds;
+		std::int64_t peakRssKilobytes;
+		std::vector<std::pair<std::string, std::int64_t>> counters;
+
+		// Whole milliseconds, as in the timing lines
+		inline long long getWallMilliseconds() const {
+			return wallMicroseconds / 1000;
+		}
+	};
+
+	StageProfiler();
+
+	// The following stages belong to this image.
+	void beginImage(QString const& fileName, int width, int height);
+
+	void beginStage(std::string const& name);
+
+	// Ends the running stage and returns it.
+	Stage const& endStage();
+
+	// Adds a counter to the running stage, or to the last one if none is running.
+	void addCounter(std::string const& name, std::int64_t value);
+
+	bool writeJson(QString const& fileName) const;
+
+	static std::int64_t getProcessCpuMicroseconds();
+
+	// Peak resident set size of the process so far
+	static std::int64_t getPeakRssKilobytes();
+private:
+	struct Image {
+		QString fileName;
+		int width;
+		int height;
+		std::vector<Stage> stages;
+	};
+
+	std::vector<Image> m_images;
+	bool m_isStageRunning;
+	std::chrono::steady_clock::time_point m_stageWallStart;
+	std::int64_t m_stageCpuStart;
+
+	Stage& getCurrentStage();
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include "StripLabeller.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <numeric>
+
+#include "ContourTracer.h"
+#include "RegionAdjacencyGraph.h"
+
+StripLabeller::StripLabeller(int width, int height) : m_w(width), m_h(height), m_nextRow(0), m_areaUnionFind(), m_areaSizes(), m_firstPixels(), m_adjacentAreas(), m_horizontalCracks(), m_verticalCracks(), m_previousRuns(), m_currentRuns(), m_packedAreas(), m_packedAreaSizes(), m_packedFirstPixels() {
+	//
+}
+
+int StripLabeller::addArea(std::uint64_t firstPixel) {
+	m_areaSizes.push_back(0);
+	m_firstPixels.push_back(firstPixel);
+	return m_areaUnionFind.addArea();
+}
+
+int StripLabeller::mergeAreas(int areaA, int areaB) {
+	int const rootA = m_areaUnionFind.find(areaA);
+	int const rootB = m_areaUnionFind.find(areaB);
+	if (rootA == rootB) {
+		return rootA;
+	}
+	int const survivor = m_areaUnionFind.unite(rootA, rootB);
+	int const absorbed = (survivor == rootA) ? rootB : rootA;
+	m_areaSizes[survivor] += m_areaSizes[absorbed];
+	m_firstPixels[survivor] = std::min(m_firstPixels[survivor], m_firstPixels[absorbed]);
+	return survivor;
+}
+
+void StripLabeller::labelStrip(BitMask const& strip, int firstRow) {
+	assert(firstRow == m_nextRow && "Internal Error: Strips have to be labelled in order!");
+	assert(strip.getWidth() == m_w && "Internal Error: Strip width does not match!");
+	m_nextRow = firstRow + strip.getHeight();
+	if (m_w <= 0) {
+		return;
+	}
+
+	struct TopOverlap {
+		int xBegin;
+		int xEnd;
+		int area;
+	};
+	std::vector<TopOverlap> differentTopRuns;
+	for (int stripRow = 0; stripRow < strip.getHeight(); ++stripRow) {
+		int const y = firstRow + stripRow;
+		extractRuns(strip, stripRow, m_currentRuns);
+
+		// Same as labelAreasByRuns(), but recording cracks and statistics instead of labels
+		std::size_t firstOverlap = 0;
+		for (std::size_t i = 0; i < m_currentRuns.size(); ++i) {
+			Run& run = m_currentRuns[i];
+			differentTopRuns.clear();
+
+			while ((firstOverlap < m_previousRuns.size()) && (m_previousRuns[firstOverlap].end <= run.begin)) {
+				++firstOverlap;
+			}
+			for (std::size_t j = firstOverlap; (j < m_previousRuns.size()) && (m_previousRuns[j].begin < run.end); ++j) {
+				Run const& topRun = m_previousRuns[j];
+				if (topRun.colour != run.colour) {
+					differentTopRuns.push_back({ std::max(topRun.begin, run.begin), std::min(topRun.end, run.end), topRun.area });
+				} else if (run.area == -1) {
+					run.area = m_areaUnionFind.find(topRun.area);
+				} else {
+					run.area = mergeAreas(topRun.area, run.area);
+				}
+			}
+			if (run.area == -1) {
+				run.area = addArea(std::numeric_limits<std::uint64_t>::max());
+			}
+
+			for (auto it = differentTopRuns.cbegin(); it != differentTopRuns.cend(); ++it) {
+				m_adjacentAreas.push_back(std::make_pair(run.area, it->area));
+				m_horizontalCracks.push_back({ y, it->xBegin, it->xEnd, it->area, run.area });
+			}
+			if (i > 0) {
+				m_adjacentAreas.push_back(std::make_pair(run.area, m_currentRuns[i - 1].area));
+				m_verticalCracks.push_back({ run.begin, y, m_currentRuns[i - 1].area, run.area });
+			}
+		}
+
+		for (auto it = m_currentRuns.begin(); it != m_currentRuns.end(); ++it) {
+			it->area = m_areaUnionFind.find(it->area);
+			m_areaSizes[it->area] += it->end - it->begin;
+			m_firstPixels[it->area] = std::min(m_firstPixels[it->area], firstPixelKey(it->begin, y));
+		}
+		m_previousRuns.swap(m_currentRuns);
+	}
+
+	// Most adjacencies repeat from row to row, so only keep the distinct ones between the current roots
+	for (auto it = m_adjacentAreas.begin(); it != m_adjacentAreas.end(); ++it) {
+		int const areaA = m_areaUnionFind.find(it->first);
+		int const areaB = m_areaUnionFind.find(it->second);
+		*it = std::make_pair(std::min(areaA, areaB), std::max(areaA, areaB));
+	}
+	std::sort(m_adjacentAreas.begin(), m_adjacentAreas.end());
+	m_adjacentAreas.erase(std::unique(m_adjacentAreas.begin(), m_adjacentAreas.end()), m_adjacentAreas.end());
+}
+
+int StripLabeller::getLabelledAreaCount() const {
+	return m_areaUnionFind.getAreaCount();
+}
+
+void StripLabeller::packAreas() {
+	assert(m_nextRow == m_h && "Internal Error: Not all strips were labelled!");
+	int const labelledAreaCount = getLabelledAreaCount();
+	std::vector<int> roots;
+	for (int area = 0; area < labelledAreaCount; ++area) {
+		if (m_areaUnionFind.find(area) == area) {
+			roots.push_back(area);
+		}
+	}
+	std::sort(roots.begin(), roots.end(), [this](int a, int b) { return m_firstPixels[a] < m_firstPixels[b]; });
+
+	std::vector<int> rootToPacked(labelledAreaCount, -1);
+	m_packedAreaSizes.clear();
+	m_packedFirstPixels.clear();
+	for (std::size_t i = 0; i < roots.size(); ++i) {
+		rootToPacked[roots[i]] = static_cast<int>(i);
+		m_packedAreaSizes.push_back(m_areaSizes[roots[i]]);
+		m_packedFirstPixels.push_back(m_firstPixels[roots[i]]);
+	}
+
+	m_packedAreas.resize(labelledAreaCount);
+	for (int area = 0; area < labelledAreaCount; ++area) {
+		m_packedAreas[area] = rootToPacked[m_areaUnionFind.find(area)];
+	}
+}
+
+std::size_t StripLabeller::absorbSmallAreas(int areaSizeThreshold) {
+	std::vector<std::pair<int, int>> edges;
+	edges.reserve(m_adjacentAreas.size());
+	for (auto it = m_adjacentAreas.cbegin(); it != m_adjacentAreas.cend(); ++it) {
+		edges.push_back(std::make_pair(m_packedAreas[it->first], m_packedAreas[it->second]));
+	}
+	RegionAdjacencyGraph adjacencyGraph(m_packedAreaSizes, std::move(edges));
+	std::size_t const absorbedAreas = adjacencyGraph.absorbSmallAreas(areaSizeThreshold);
+
+	// Renumber the surviving areas by their first pixel, as packAreas() after merging does
+	int const areaCount = getAreaCount();
+	std::vector<std::uint64_t> firstPixels(areaCount, std::numeric_limits<std::uint64_t>::max());
+	std::vector<int> roots;
+	for (int area = 0; area < areaCount; ++area) {
+		int const root = adjacencyGraph.resolveArea(area);
+		firstPixels[root] = std::min(firstPixels[root], m_packedFirstPixels[area]);
+		if (root == area) {
+			roots.push_back(area);
+		}
+	}
+	std::sort(roots.begin(), roots.end(), [&firstPixels](int a, int b) { return firstPixels[a] < firstPixels[b]; });
+
+	std::vector<int> rootToPacked(areaCount, -1);
+	std::vector<int> packedAreaSizes;
+	std::vector<std::uint64_t> packedFirstPixels;
+	for (std::size_t i = 0; i < roots.size(); ++i) {
+		rootToPacked[roots[i]] = static_cast<int>(i);
+		packedAreaSizes.push_back(adjacencyGraph.getAreaSize(roots[i]));
+		packedFirstPixels.push_back(firstPixels[roots[i]]);
+	}
+	for (auto it = m_packedAreas.begin(); it != m_packedAreas.end(); ++it) {
+		*it = rootToPacked[adjacencyGraph.resolveArea(*it)];
+	}
+	m_packedAreaSizes.swap(packedAreaSizes);
+	m_packedFirstPixels.swap(packedFirstPixels);
+	return absorbedAreas;
+}
+
+int StripLabeller::getAreaCount() const {
+	return static_cast<int>(m_packedAreaSizes.size());
+}
+
+int StripLabeller::getAreaMemberCount(int area) const {
+	return m_packedAreaSizes.at(area);
+}
+
+std::size_t StripLabeller::getCrackCount() const {
+	std::size_t crackCount = m_verticalCracks.size();
+	for (auto it = m_horizontalCracks.cbegin(); it != m_horizontalCracks.cend(); ++it) {
+		crackCount += it->xEnd - it->xBegin;
+	}
+	return crackCount;
+}
+
+std::vector<std::vector<std::vector<Point>>> StripLabeller::traceContoursPerArea() const {
+	// Both sides of every crack between different areas, each with the area it belongs to
+	std::vector<std::pair<std::uint64_t, int>> cracks;
+	for (auto it = m_horizontalCracks.cbegin(); it != m_horizontalCracks.cend(); ++it) {
+		int const topArea = m_packedAreas[it->topArea];
+		int const bottomArea = m_packedAreas[it->bottomArea];
+		if (topArea == bottomArea) {
+			continue;
+		}
+		for (int x = it->xBegin; x < it->xEnd; ++x) {
+			cracks.push_back(std::make_pair(makeCrackKey(x, it->y - 1, PixelSide::Bottom), topArea));
+			cracks.push_back(std::make_pair(makeCrackKey(x, it->y, PixelSide::Top), bottomArea));
+		}
+	}
+	for (auto it = m_verticalCracks.cbegin(); it != m_verticalCracks.cend(); ++it) {
+		int const leftArea = m_packedAreas[it->leftArea];
+		int const rightArea = m_packedAreas[it->rightArea];
+		if (leftArea != rightArea) {
+			cracks.push_back(std::make_pair(makeCrackKey(it->x - 1, it->y, PixelSide::Right), leftArea));
+			cracks.push_back(std::make_pair(makeCrackKey(it->x, it->y, PixelSide::Left), rightArea));
+		}
+	}
+	std::sort(cracks.begin(), cracks.end());
+
+	std::vector<std::uint64_t> crackKeys;
+	std::vector<int> crackAreas;
+	crackKeys.reserve(cracks.size());
+	crackAreas.reserve(cracks.size());
+	for (auto it = cracks.cbegin(); it != cracks.cend(); ++it) {
+		crackKeys.push_back(it->first);
+		crackAreas.push_back(it->second);
+	}
+	std::vector<std::pair<std::uint64_t, int>>().swap(cracks);
+
+	return traceContoursOfCracks(m_w, m_h, getAreaCount(), crackKeys, crackAreas);
+}
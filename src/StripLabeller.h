@@ -0,0 +1,92 @@
+#ifndef EDGEFINDER_STRIPLABELLER_H_
+#define EDGEFINDER_STRIPLABELLER_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "AreaLabeller.h"
+#include "AreaUnionFind.h"
+#include "BitMask.h"
+#include "Point.h"
+
+/*
+	Labels an image strip by strip, only carrying the runs of the last row from one strip to the next.
+	Instead of a label per pixel it keeps the size and first pixel of every area, which areas touch and the cracks between them,
+	so memory grows with the number of areas and the length of their outlines rather than with the image area.
+	Numbering, small area merging and tracing then give the same areas and outlines as the in-memory pipeline with contour tracing.
+*/
+class StripLabeller {
+public:
+	StripLabeller(int width, int height);
+
+	// Labels the rows [firstRow, firstRow + strip.getHeight()) of the image. Strips have to follow each other from the top.
+	void labelStrip(BitMask const& strip, int firstRow);
+
+	// Areas created while labelling, before any of them were found to be connected.
+	int getLabelledAreaCount() const;
+
+	// Numbers the connected areas like AreaInformation::packAreas() would. Call once all strips are labelled.
+	void packAreas();
+
+	// Absorbs small areas like RegionAdjacencyGraph::absorbSmallAreas() and numbers the rest like packAreas() again.
+	// Returns the number of absorbed areas.
+	std::size_t absorbSmallAreas(int areaSizeThreshold);
+
+	int getAreaCount() const;
+
+	int getAreaMemberCount(int area) const;
+
+	std::size_t getCrackCount() const;
+
+	// Outlines per area, the same as traceContoursPerArea() gives for the packed labels.
+	std::vector<std::vector<std::vector<Point>>> traceContoursPerArea() const;
+private:
+	// Cracks between rows y - 1 and y, for the pixels [xBegin, xEnd)
+	struct HorizontalCracks {
+		int y;
+		int xBegin;
+		int xEnd;
+		int topArea;
+		int bottomArea;
+	};
+
+	// Crack between the pixels x - 1 and x of row y
+	struct VerticalCrack {
+		int x;
+		int y;
+		int leftArea;
+		int rightArea;
+	};
+
+	int const m_w;
+	int const m_h;
+	int m_nextRow;
+
+	// Per labelled area, sizes and first pixels are only kept up to date for the roots
+	AreaUnionFind m_areaUnionFind;
+	std::vector<int> m_areaSizes;
+	std::vector<std::uint64_t> m_firstPixels;
+
+	std::vector<std::pair<int, int>> m_adjacentAreas;
+	std::vector<HorizontalCracks> m_horizontalCracks;
+	std::vector<VerticalCrack> m_verticalCracks;
+
+	std::vector<Run> m_previousRuns;
+	std::vector<Run> m_currentRuns;
+
+	// Labelled area to packed area, and per packed area
+	std::vector<int> m_packedAreas;
+	std::vector<int> m_packedAreaSizes;
+	std::vector<std::uint64_t> m_packedFirstPixels;
+
+	int addArea(std::uint64_t firstPixel);
+	int mergeAreas(int areaA, int areaB);
+
+	// packAreas() numbers areas in the order they first appear row by row
+	static inline std::uint64_t firstPixelKey(int x, int y) {
+		return (static_cast<std::uint64_t>(y) << 32) | static_cast<std::uint32_t>(x);
+	}
+};
+
+#endif
@@ -1,9 +1,10 @@
 #include "SvgBuilder.h"
 
-QString SvgBuilder::buildSvgFromLines(std::vector<std::vector<Point>> const& lines) {
-	QString result;
-	result.reserve(16 * 1024 * 1024); // 16 MB
-    result.append(R"F00BAR(<?xml version="1.0" encoding="UTF-8" standalone="no"?>
+#include <charconv>
+#include <cstring>
+
+namespace {
+	char const* const svgHeader = R"F00BAR(<?xml version="1.0" encoding="UTF-8" standalone="no"?>
 <!-- Created with Inkscape (http://www.inkscape.org/) -->
 
 <svg
@@ -38,21 +39,121 @@ QString SvgBuilder::buildSvgFromLines(std::vector<std::vector<Point>> const& lin
      inkscape:window-y="-11"
      inkscape:window-maximized="1"
      inkscape:current-layer="layer1" />
-)F00BAR");
+)F00BAR";
+	char const* const svgFooter = R"F00BAR(  </g>
+</svg>
+)F00BAR";
+	char const* const pathStart = R"F00BAR(    <path
+       style="fill:none;stroke:#ff0000;stroke-width:0.26458333;stroke-linecap:butt;stroke-linejoin:miter;stroke-opacity:1;stroke-dasharray:none;vector-effect:non-scaling-stroke;-inkscape-stroke:hairline"
+       d="M)F00BAR";
+	char const* const pathIdStart = R"F00BAR("
+       id="path)F00BAR";
+	char const* const pathEnd = R"F00BAR(" />
+)F00BAR";
+
+	// Collects output in a fixed buffer and hands it to the file in large blocks, so the document never exists in memory as a whole
+	class BufferedFileSink {
+	public:
+		explicit BufferedFileSink(QFile& file) : m_file(file), m_buffer(1024 * 1024), m_used(0), m_isOk(true) {
+			//
+		}
+
+		void append(char const* text) {
+			append(text, std::strlen(text));
+		}
+
+		void append(char c) {
+			reserve(1);
+			m_buffer[m_used++] = c;
+		}
+
+		void append(char const* text, std::size_t length) {
+			if (length > m_buffer.size()) {
+				flush();
+				m_isOk = m_isOk && (m_file.write(text, static_cast<qint64>(length)) == static_cast<qint64>(length));
+				return;
+			}
+			reserve(length);
+			std::memcpy(m_buffer.data() + m_used, text, length);
+			m_used += length;
+		}
+
+		// Same text as QString::number(value, 'f'), that is fixed notation with six decimals
+		void appendFixed(double value) {
+			reserve(maxNumberLength);
+			auto const result = std::to_chars(m_buffer.data() + m_used, m_buffer.data() + m_buffer.size(), value, std::chars_format::fixed, 6);
+			if (result.ec != std::errc()) {
+				// Only huge magnitudes do not fit, QString would print them in full as well
+				append(QString::number(value, 'f').toUtf8().constData());
+				return;
+			}
+			m_used = static_cast<std::size_t>(result.ptr - m_buffer.data());
+		}
+
+		void appendInteger(std::size_t value) {
+			reserve(maxNumberLength);
+			auto const result = std::to_chars(m_buffer.data() + m_used, m_buffer.data() + m_buffer.size(), value);
+			m_used = static_cast<std::size_t>(result.ptr - m_buffer.data());
+		}
+
+		bool flush() {
+			if (m_used > 0) {
+				m_isOk = m_isOk && (m_file.write(m_buffer.data(), static_cast<qint64>(m_used)) == static_cast<qint64>(m_used));
+				m_used = 0;
+			}
+			return m_isOk;
+		}
+	private:
+		static std::size_t const maxNumberLength = 64;
+
+		QFile& m_file;
+		std::vector<char> m_buffer;
+		std::size_t m_used;
+		bool m_isOk;
+
+		inline void reserve(std::size_t length) {
+			if (m_used + length > m_buffer.size()) {
+				flush();
+			}
+		}
+	};
+}
+
+QString SvgBuilder::buildSvgFromLines(std::vector<std::vector<Point>> const& lines) {
+	QString result;
+	result.reserve(16 * 1024 * 1024); // 16 MB
+    result.append(svgHeader);
     for (auto it = lines.cbegin(); it != lines.cend(); ++it) {
         auto const& line = *it;
         appendLine(result, line);
     }
-    result.append(R"F00BAR(  </g>
-</svg>
-)F00BAR");
+    result.append(svgFooter);
     return result;
 }
 
+bool SvgBuilder::writeSvgFromLines(std::vector<std::vector<Point>> const& lines, QFile& file) {
+	BufferedFileSink sink(file);
+	sink.append(svgHeader);
+	for (auto const& line : lines) {
+		sink.append(pathStart);
+		for (auto const& point : line) {
+			Point const p = scalePoint(point);
+			sink.append(' ');
+			sink.appendFixed(p.first);
+			sink.append(',');
+			sink.appendFixed(p.second);
+		}
+		sink.append(pathIdStart);
+		sink.appendInteger(m_pathIdCounter);
+		sink.append(pathEnd);
+		++m_pathIdCounter;
+	}
+	sink.append(svgFooter);
+	return sink.flush();
+}
+
 void SvgBuilder::appendLine(QString& out, std::vector<Point> const& line) {
-    out.append(R"F00BAR(    <path
-       style="fill:none;stroke:#ff0000;stroke-width:0.26458333;stroke-linecap:butt;stroke-linejoin:miter;stroke-opacity:1;stroke-dasharray:none;vector-effect:non-scaling-stroke;-inkscape-stroke:hairline"
-       d="M)F00BAR");
+    out.append(pathStart);
     for (auto it = line.cbegin(); it != line.cend(); ++it) {
         Point const p = scalePoint (*it);
         out.append(' ');
@@ -60,8 +161,8 @@ void SvgBuilder::appendLine(QString& out, std::vector<Point> const& line) {
         out.append(',');
         out.append(QString::number(p.second, 'f'));
     }
-    out.append(QString(R"F00BAR("
-       id="path%1" />
-)F00BAR").arg(m_pathIdCounter));
+    out.append(pathIdStart);
+    out.append(QString::number(m_pathIdCounter));
+    out.append(pathEnd);
     ++m_pathIdCounter;
-}
\ No newline at end of file
+}
@@ -5,27 +5,34 @@
 #include <iostream>
 #include <vector>
 
+#include <QFile>
 #include <QString>
 
 #include "Point.h"
 
 class SvgBuilder {
 public:
-	SvgBuilder(int w, int h, double tW, double tH) : m_imageWidth(w), m_imageHeight(h), m_targetWidth(tW), m_targetHeight(tH), m_pathIdCounter(176) {
+	// The points are relative to (offsetX, offsetY) of the w x h image, e.g. the top left corner of EdgeFinderResult::crop
+	SvgBuilder(int w, int h, double tW, double tH, int offsetX, int offsetY) : m_imageWidth(w), m_imageHeight(h), m_targetWidth(tW), m_targetHeight(tH), m_offsetX(offsetX), m_offsetY(offsetY), m_pathIdCounter(176) {
 		//
 	}
 
 	QString buildSvgFromLines(std::vector<std::vector<Point>> const& lines);
+
+	// Writes the same document as buildSvgFromLines() as UTF-8 to the opened file, streaming it through a small buffer.
+	bool writeSvgFromLines(std::vector<std::vector<Point>> const& lines, QFile& file);
 private:
 	int const m_imageWidth;
 	int const m_imageHeight;
 	double const m_targetWidth;
 	double const m_targetHeight;
+	int const m_offsetX;
+	int const m_offsetY;
 	std::size_t m_pathIdCounter;
 
 	inline Point scalePoint(Point const& p) const {
 		//std::cout << "x = " << p.first << " -> " << ((p.first / m_imageWidth) * m_targetWidth) << ", y = " << p.second << " -> " << ((p.second / m_imageHeight) * m_targetHeight) << std::endl;
-		return std::make_pair((p.first / m_imageWidth) * m_targetWidth, (p.second / m_imageHeight) * m_targetHeight);
+		return std::make_pair(((p.first + m_offsetX) / m_imageWidth) * m_targetWidth, ((p.second + m_offsetY) / m_imageHeight) * m_targetHeight);
 	}
 	void appendLine(QString& out, std::vector<Point> const& line);
 };
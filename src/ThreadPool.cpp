@@ -0,0 +1,171 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace {
+	// Which pool the current thread works for and which queue it owns, the creating thread owns queue 0
+	thread_local ThreadPool const* currentPool = nullptr;
+	thread_local int currentQueueIndex = 0;
+
+	// Only the outermost task on a thread is timed, tasks run while waiting inside it are part of its time
+	thread_local int taskNestingDepth = 0;
+
+	// CPU time of the calling thread, so threads that merely wait for a core are not counted as busy
+	std::int64_t getThreadCpuNanoseconds() {
+#ifdef _WIN32
+		FILETIME creationTime, exitTime, kernelTime, userTime;
+		GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime);
+		ULARGE_INTEGER kernel, user;
+		kernel.LowPart = kernelTime.dwLowDateTime;
+		kernel.HighPart = kernelTime.dwHighDateTime;
+		user.LowPart = userTime.dwLowDateTime;
+		user.HighPart = userTime.dwHighDateTime;
+		return static_cast<std::int64_t>(kernel.QuadPart + user.QuadPart) * 100;
+#else
+		timespec time;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+		return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+#endif
+	}
+}
+
+ThreadPool::TaskGroup::TaskGroup() : m_pendingTaskCount(0) {
+	//
+}
+
+ThreadPool::ThreadPool(int threadCount) : m_threadCount(std::max(1, threadCount)), m_queues(), m_workers(), m_sleepMutex(), m_sleepCondition(), m_queuedTaskCount(0), m_isStopping(false), m_busyNanoseconds(0) {
+	for (int i = 0; i < m_threadCount; ++i) {
+		m_queues.push_back(std::make_unique<WorkQueue>());
+	}
+	m_workers.reserve(m_threadCount - 1);
+	for (int i = 1; i < m_threadCount; ++i) {
+		m_workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_isStopping = true;
+	}
+	m_sleepCondition.notify_all();
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(TaskGroup& taskGroup, std::function<void()> task) {
+	taskGroup.m_pendingTaskCount.fetch_add(1, std::memory_order_relaxed);
+
+	WorkQueue& queue = *m_queues[getOwnQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back({ std::move(task), &taskGroup });
+	}
+
+	// Taking the sleep mutex orders the increment against a worker that just found nothing and is about to sleep
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queuedTaskCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	m_sleepCondition.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup& taskGroup) {
+	int const queueIndex = getOwnQueueIndex();
+	while (taskGroup.m_pendingTaskCount.load(std::memory_order_acquire) > 0) {
+		if (tryRunTask(queueIndex)) {
+			continue;
+		}
+
+		// The remaining tasks of the group are running elsewhere
+		std::int64_t const idleStart = getThreadCpuNanoseconds();
+		std::this_thread::yield();
+		if (taskNestingDepth > 0) {
+			m_busyNanoseconds.fetch_sub(getThreadCpuNanoseconds() - idleStart, std::memory_order_relaxed);
+		}
+	}
+}
+
+int ThreadPool::getThreadCount() const {
+	return m_threadCount;
+}
+
+std::chrono::nanoseconds ThreadPool::getBusyTime() const {
+	return std::chrono::nanoseconds(m_busyNanoseconds.load(std::memory_order_relaxed));
+}
+
+void ThreadPool::workerLoop(int queueIndex) {
+	currentPool = this;
+	currentQueueIndex = queueIndex;
+	while (true) {
+		if (tryRunTask(queueIndex)) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_sleepCondition.wait(lock, [this]() { return m_isStopping || (m_queuedTaskCount.load(std::memory_order_relaxed) > 0); });
+		if (m_isStopping) {
+			return;
+		}
+	}
+}
+
+bool ThreadPool::tryRunTask(int queueIndex) {
+	Task task;
+	if (!tryPopTask(queueIndex, task)) {
+		return false;
+	}
+	runTask(task);
+	return true;
+}
+
+bool ThreadPool::tryPopTask(int queueIndex, Task& task) {
+	// Newest own task first, it is the one most likely still in the cache
+	{
+		WorkQueue& queue = *m_queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			m_queuedTaskCount.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Then steal the oldest task of another thread, usually the largest piece of work it has split off
+	for (int i = 1; i < m_threadCount; ++i) {
+		WorkQueue& queue = *m_queues[(queueIndex + i) % m_threadCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			m_queuedTaskCount.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::runTask(Task& task) {
+	std::int64_t const taskStart = getThreadCpuNanoseconds();
+	++taskNestingDepth;
+	task.function();
+	--taskNestingDepth;
+	if (taskNestingDepth == 0) {
+		m_busyNanoseconds.fetch_add(getThreadCpuNanoseconds() - taskStart, std::memory_order_relaxed);
+	}
+	task.taskGroup->m_pendingTaskCount.fetch_sub(1, std::memory_order_release);
+}
+
+int ThreadPool::getOwnQueueIndex() const {
+	// Threads outside of this pool, including the one that created it, share queue 0
+	return (currentPool == this) ? currentQueueIndex : 0;
+}
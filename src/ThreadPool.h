@@ -0,0 +1,72 @@
+#ifndef EDGEFINDER_THREADPOOL_H_
+#define EDGEFINDER_THREADPOOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+	Work-stealing pool: every worker owns a deque, pushes and pops its own tasks at the back and steals from the front of the others.
+	The thread that created the pool counts as one of the threads, it only works while it waits for a task group.
+	Tasks may add further tasks to their group or wait for nested groups, the waiting thread keeps running tasks meanwhile.
+*/
+class ThreadPool {
+public:
+	class TaskGroup {
+	public:
+		TaskGroup();
+	private:
+		friend class ThreadPool;
+		std::atomic<int> m_pendingTaskCount;
+	};
+
+	// Uses threadCount - 1 workers in addition to the calling thread, so a count of 1 runs everything sequentially in wait().
+	explicit ThreadPool(int threadCount);
+	~ThreadPool();
+
+	ThreadPool(ThreadPool const&) = delete;
+	ThreadPool& operator=(ThreadPool const&) = delete;
+
+	void run(TaskGroup& taskGroup, std::function<void()> task);
+	void wait(TaskGroup& taskGroup);
+
+	int getThreadCount() const;
+
+	// CPU time all threads spent running tasks so far, excluding time a task spent idling in wait(). Compare against wall time for the speedup.
+	std::chrono::nanoseconds getBusyTime() const;
+private:
+	struct Task {
+		std::function<void()> function;
+		TaskGroup* taskGroup;
+	};
+
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	int const m_threadCount;
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_sleepCondition;
+	std::atomic<int> m_queuedTaskCount;
+	std::atomic<bool> m_isStopping;
+	std::atomic<std::int64_t> m_busyNanoseconds;
+
+	void workerLoop(int queueIndex);
+	bool tryRunTask(int queueIndex);
+	bool tryPopTask(int queueIndex, Task& task);
+	void runTask(Task& task);
+	int getOwnQueueIndex() const;
+};
+
+#endif
@@ -0,0 +1,322 @@
+#include "Threshold.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define EDGEFINDER_THRESHOLD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(EDGEFINDER_THRESHOLD_X86) && !defined(_MSC_VER)
+#define EDGEFINDER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define EDGEFINDER_TARGET_AVX2
+#endif
+
+namespace {
+	inline bool isWhite(std::uint32_t rgb, int colourThreshold) {
+		return (static_cast<int>((rgb >> 16) & 0xFFu) > colourThreshold) && (static_cast<int>((rgb >> 8) & 0xFFu) > colourThreshold) && (static_cast<int>(rgb & 0xFFu) > colourThreshold);
+	}
+
+	void thresholdRowScalar(std::uint32_t const* pixels, int width, int colourThreshold, std::uint64_t* outWords) {
+		int const wordCount = (width + 63) / 64;
+		for (int i = 0; i < wordCount; ++i) {
+			int const begin = i * 64;
+			int const end = std::min(width, begin + 64);
+			std::uint64_t word = 0;
+			for (int x = begin; x < end; ++x) {
+				word |= static_cast<std::uint64_t>(isWhite(pixels[x], colourThreshold)) << (x - begin);
+			}
+			outWords[i] = word;
+		}
+	}
+
+	// The byte formats, specialised per format at compile time. Every compare also holds for thresholds outside of [0, 254].
+	template <PixelFormat Format>
+	inline bool isWhitePixel(std::uint8_t const* row, int x, int colourThreshold, std::uint8_t const* whiteIndices) {
+		if constexpr (Format == PixelFormat::Rgb888) {
+			return (row[3 * x] > colourThreshold) & (row[3 * x + 1] > colourThreshold) & (row[3 * x + 2] > colourThreshold);
+		} else if constexpr (Format == PixelFormat::Grayscale8) {
+			return row[x] > colourThreshold;
+		} else {
+			return whiteIndices[row[x]] != 0;
+		}
+	}
+
+	template <PixelFormat Format>
+	void thresholdByteRowScalar(std::uint8_t const* row, int width, int colourThreshold, std::uint8_t const* whiteIndices, std::uint64_t* outWords) {
+		int const wordCount = (width + 63) / 64;
+		for (int i = 0; i < wordCount; ++i) {
+			int const begin = i * 64;
+			int const end = std::min(width, begin + 64);
+			std::uint64_t word = 0;
+			for (int x = begin; x < end; ++x) {
+				word |= static_cast<std::uint64_t>(isWhitePixel<Format>(row, x, colourThreshold, whiteIndices)) << (x - begin);
+			}
+			outWords[i] = word;
+		}
+	}
+
+	// Only thresholds in [0, 254] are handled by the vector kernels, everything else is constant
+	bool isConstantThreshold(int colourThreshold) {
+		return (colourThreshold < 0) || (colourThreshold > 254);
+	}
+
+	void fillConstantRow(int width, int colourThreshold, std::uint64_t* outWords) {
+		int const wordCount = (width + 63) / 64;
+		std::fill(outWords, outWords + wordCount, (colourThreshold < 0) ? ~std::uint64_t(0) : std::uint64_t(0));
+		if ((colourThreshold < 0) && ((width & 63) != 0)) {
+			outWords[wordCount - 1] = (std::uint64_t(1) << (width & 63)) - 1;
+		}
+	}
+
+#ifdef EDGEFINDER_THRESHOLD_X86
+	/*
+		A byte is greater than the threshold exactly if the saturating subtraction of the threshold leaves it non-zero.
+		We collect the bytes that are not, drop the alpha channel and call a pixel white if none of its RGB bytes remain.
+	*/
+	void thresholdRowSse2(std::uint32_t const* pixels, int width, int colourThreshold, std::uint64_t* outWords) {
+		__m128i const threshold = _mm_set1_epi8(static_cast<char>(colourThreshold));
+		__m128i const rgbMask = _mm_set1_epi32(0x00FFFFFF);
+		__m128i const zero = _mm_setzero_si128();
+
+		int const fullWords = width / 64;
+		for (int i = 0; i < fullWords; ++i) {
+			std::uint32_t const* block = pixels + static_cast<std::size_t>(i) * 64;
+			std::uint64_t word = 0;
+			for (int j = 0; j < 16; ++j) {
+				__m128i const rgb = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + j * 4));
+				__m128i const notGreater = _mm_and_si128(_mm_cmpeq_epi8(_mm_subs_epu8(rgb, threshold), zero), rgbMask);
+				__m128i const white = _mm_cmpeq_epi32(notGreater, zero);
+				word |= static_cast<std::uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(white))) << (j * 4);
+			}
+			outWords[i] = word;
+		}
+		if ((width & 63) != 0) {
+			thresholdRowScalar(pixels + static_cast<std::size_t>(fullWords) * 64, width & 63, colourThreshold, outWords + fullWords);
+		}
+	}
+
+	// The same subtraction on grey bytes, 16 pixels per compare
+	void thresholdGreyRowSse2(std::uint8_t const* row, int width, int colourThreshold, std::uint8_t const* whiteIndices, std::uint64_t* outWords) {
+		__m128i const threshold = _mm_set1_epi8(static_cast<char>(colourThreshold));
+		__m128i const zero = _mm_setzero_si128();
+
+		int const fullWords = width / 64;
+		for (int i = 0; i < fullWords; ++i) {
+			std::uint8_t const* block = row + static_cast<std::size_t>(i) * 64;
+			std::uint64_t word = 0;
+			for (int j = 0; j < 4; ++j) {
+				__m128i const grey = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + j * 16));
+				__m128i const notGreater = _mm_cmpeq_epi8(_mm_subs_epu8(grey, threshold), zero);
+				word |= static_cast<std::uint64_t>(~_mm_movemask_epi8(notGreater) & 0xFFFF) << (j * 16);
+			}
+			outWords[i] = word;
+		}
+		if ((width & 63) != 0) {
+			thresholdByteRowScalar<PixelFormat::Grayscale8>(row + static_cast<std::size_t>(fullWords) * 64, width & 63, colourThreshold, whiteIndices, outWords + fullWords);
+		}
+	}
+
+	EDGEFINDER_TARGET_AVX2 void thresholdRowAvx2(std::uint32_t const* pixels, int width, int colourThreshold, std::uint64_t* outWords) {
+		__m256i const threshold = _mm256_set1_epi8(static_cast<char>(colourThreshold));
+		__m256i const rgbMask = _mm256_set1_epi32(0x00FFFFFF);
+		__m256i const zero = _mm256_setzero_si256();
+
+		int const fullWords = width / 64;
+		for (int i = 0; i < fullWords; ++i) {
+			std::uint32_t const* block = pixels + static_cast<std::size_t>(i) * 64;
+			std::uint64_t word = 0;
+			for (int j = 0; j < 8; ++j) {
+				__m256i const rgb = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(block + j * 8));
+				__m256i const notGreater = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(rgb, threshold), zero), rgbMask);
+				__m256i const white = _mm256_cmpeq_epi32(notGreater, zero);
+				word |= static_cast<std::uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(white))) << (j * 8);
+			}
+			outWords[i] = word;
+		}
+		if ((width & 63) != 0) {
+			thresholdRowScalar(pixels + static_cast<std::size_t>(fullWords) * 64, width & 63, colourThreshold, outWords + fullWords);
+		}
+	}
+
+	// Four packed RGB888 pixels from the low 12 bytes, spread into 32bit lanes with R repeated as the fourth byte, so all four bytes have to be greater
+	EDGEFINDER_TARGET_AVX2 inline int thresholdFourRgb888(__m128i pixels, __m128i threshold) {
+		__m128i const spread = _mm_setr_epi8(0, 1, 2, 0, 3, 4, 5, 3, 6, 7, 8, 6, 9, 10, 11, 9);
+		__m128i const zero = _mm_setzero_si128();
+		__m128i const notGreater = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_shuffle_epi8(pixels, spread), threshold), zero);
+		return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(notGreater, zero)));
+	}
+
+	// Only needs SSSE3, but every CPU with AVX2 has it, which saves checking for it on its own
+	EDGEFINDER_TARGET_AVX2 void thresholdRgb888RowAvx2(std::uint8_t const* row, int width, int colourThreshold, std::uint8_t const* whiteIndices, std::uint64_t* outWords) {
+		__m128i const threshold = _mm_set1_epi8(static_cast<char>(colourThreshold));
+
+		int const fullWords = width / 64;
+		for (int i = 0; i < fullWords; ++i) {
+			std::uint8_t const* block = row + static_cast<std::size_t>(i) * 64 * 3;
+			std::uint64_t word = 0;
+			for (int j = 0; j < 4; ++j) {
+				// 16 pixels in 48 bytes, realigned to the start of every fourth pixel
+				__m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + j * 48));
+				__m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + j * 48 + 16));
+				__m128i const c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + j * 48 + 32));
+				int const white = thresholdFourRgb888(a, threshold) | (thresholdFourRgb888(_mm_alignr_epi8(b, a, 12), threshold) << 4) | (thresholdFourRgb888(_mm_alignr_epi8(c, b, 8), threshold) << 8) | (thresholdFourRgb888(_mm_srli_si128(c, 4), threshold) << 12);
+				word |= static_cast<std::uint64_t>(white) << (j * 16);
+			}
+			outWords[i] = word;
+		}
+		if ((width & 63) != 0) {
+			thresholdByteRowScalar<PixelFormat::Rgb888>(row + static_cast<std::size_t>(fullWords) * 64 * 3, width & 63, colourThreshold, whiteIndices, outWords + fullWords);
+		}
+	}
+
+	bool cpuSupportsAvx2() {
+#ifdef _MSC_VER
+		int info[4] = { 0, 0, 0, 0 };
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		bool const osUsesXsave = (info[2] & (1 << 27)) != 0;
+		bool const hasAvx = (info[2] & (1 << 28)) != 0;
+		if (!osUsesXsave || !hasAvx || ((_xgetbv(0) & 0x6) != 0x6)) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+ThresholdKernel getBestThresholdKernel() {
+	static ThresholdKernel const bestKernel = isThresholdKernelSupported(ThresholdKernel::Avx2) ? ThresholdKernel::Avx2 : (isThresholdKernelSupported(ThresholdKernel::Sse2) ? ThresholdKernel::Sse2 : ThresholdKernel::Scalar);
+	return bestKernel;
+}
+
+bool isThresholdKernelSupported(ThresholdKernel kernel) {
+	switch (kernel) {
+		case ThresholdKernel::Scalar:
+			return true;
+#ifdef EDGEFINDER_THRESHOLD_X86
+		case ThresholdKernel::Sse2:
+			return true;
+		case ThresholdKernel::Avx2:
+			return cpuSupportsAvx2();
+#endif
+		default:
+			return false;
+	}
+}
+
+char const* getThresholdKernelName(ThresholdKernel kernel) {
+	switch (kernel) {
+		case ThresholdKernel::Scalar:
+			return "scalar";
+		case ThresholdKernel::Sse2:
+			return "SSE2";
+		case ThresholdKernel::Avx2:
+			return "AVX2";
+	}
+	return "unknown";
+}
+
+void thresholdRow(ThresholdKernel kernel, std::uint32_t const* pixels, int width, int colourThreshold, std::uint64_t* outWords) {
+	if (isConstantThreshold(colourThreshold)) {
+		fillConstantRow(width, colourThreshold, outWords);
+		return;
+	}
+
+	switch (kernel) {
+#ifdef EDGEFINDER_THRESHOLD_X86
+		case ThresholdKernel::Sse2:
+			thresholdRowSse2(pixels, width, colourThreshold, outWords);
+			return;
+		case ThresholdKernel::Avx2:
+			thresholdRowAvx2(pixels, width, colourThreshold, outWords);
+			return;
+#endif
+		default:
+			thresholdRowScalar(pixels, width, colourThreshold, outWords);
+			return;
+	}
+}
+
+namespace {
+	// Gives the RGB32 kernels the signature of the byte ones
+	template <ThresholdKernel Kernel>
+	void thresholdRgb32Row(std::uint8_t const* row, int width, int colourThreshold, std::uint8_t const*, std::uint64_t* outWords) {
+		thresholdRow(Kernel, reinterpret_cast<std::uint32_t const*>(row), width, colourThreshold, outWords);
+	}
+}
+
+ImageThresholder::ImageThresholder(ImageView const& image, int colourThreshold) : m_pixels(image.pixels), m_bytesPerLine(image.bytesPerLine), m_width(image.width), m_colourThreshold(colourThreshold), m_kernel(nullptr), m_kernelName(getPixelFormatName(image.format)), m_whiteIndices() {
+	char const* kernelName = "scalar";
+	switch (image.format) {
+		case PixelFormat::Rgb32: {
+			ThresholdKernel const kernel = getBestThresholdKernel();
+			kernelName = getThresholdKernelName(kernel);
+			switch (kernel) {
+				case ThresholdKernel::Avx2:
+					m_kernel = &thresholdRgb32Row<ThresholdKernel::Avx2>;
+					break;
+				case ThresholdKernel::Sse2:
+					m_kernel = &thresholdRgb32Row<ThresholdKernel::Sse2>;
+					break;
+				default:
+					m_kernel = &thresholdRgb32Row<ThresholdKernel::Scalar>;
+					break;
+			}
+			break;
+		}
+		case PixelFormat::Rgb888:
+			m_kernel = &thresholdByteRowScalar<PixelFormat::Rgb888>;
+#ifdef EDGEFINDER_THRESHOLD_X86
+			if (!isConstantThreshold(colourThreshold) && (getBestThresholdKernel() == ThresholdKernel::Avx2)) {
+				m_kernel = &thresholdRgb888RowAvx2;
+				kernelName = getThresholdKernelName(ThresholdKernel::Avx2);
+			}
+#endif
+			break;
+		case PixelFormat::Grayscale8:
+			m_kernel = &thresholdByteRowScalar<PixelFormat::Grayscale8>;
+#ifdef EDGEFINDER_THRESHOLD_X86
+			if (!isConstantThreshold(colourThreshold)) {
+				m_kernel = &thresholdGreyRowSse2;
+				kernelName = getThresholdKernelName(ThresholdKernel::Sse2);
+			}
+#endif
+			break;
+		case PixelFormat::Indexed8:
+			// Missing palette entries are transparent black
+			for (int i = 0; i < 256; ++i) {
+				m_whiteIndices[i] = isWhite((static_cast<std::size_t>(i) < image.palette.size()) ? image.palette[i] : 0u, colourThreshold) ? 1 : 0;
+			}
+			m_kernel = &thresholdByteRowScalar<PixelFormat::Indexed8>;
+			kernelName = "palette table";
+			break;
+	}
+	m_kernelName = m_kernelName + ", " + kernelName;
+}
+
+void ImageThresholder::thresholdRow(int y, std::uint64_t* outWords) const {
+	m_kernel(m_pixels + static_cast<std::size_t>(y) * m_bytesPerLine, m_width, m_colourThreshold, m_whiteIndices, outWords);
+}
+
+std::string const& ImageThresholder::getKernelName() const {
+	return m_kernelName;
+}
+
+void thresholdImage(ImageView const& image, int colourThreshold, BitMask& mask) {
+	ImageThresholder const thresholder(image, colourThreshold);
+	for (int y = 0; y < mask.getHeight(); ++y) {
+		thresholder.thresholdRow(y, mask.getRow(y));
+	}
+}
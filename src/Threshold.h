@@ -0,0 +1,55 @@
+#ifndef EDGEFINDER_THRESHOLD_H_
+#define EDGEFINDER_THRESHOLD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "BitMask.h"
+#include "ImageView.h"
+
+enum class ThresholdKernel {
+	Scalar,
+	Sse2,
+	Avx2
+};
+
+// The fastest kernel supported by the CPU we are running on, determined once.
+ThresholdKernel getBestThresholdKernel();
+
+bool isThresholdKernelSupported(ThresholdKernel kernel);
+
+char const* getThresholdKernelName(ThresholdKernel kernel);
+
+// Thresholds one row of 32bit 0xAARRGGBB pixels: a pixel is white (bit set) if every RGB component is greater than colourThreshold.
+void thresholdRow(ThresholdKernel kernel, std::uint32_t const* pixels, int width, int colourThreshold, std::uint64_t* outWords);
+
+// Thresholds the rows of one image with a kernel specialised for its pixel format, which is picked once on construction.
+// RGB32 gets the best kernel above, Grayscale8 a single compare per pixel, RGB888 reads the packed three bytes of every pixel
+// and Indexed8 looks its pixels up in a decision per palette entry, made up front.
+class ImageThresholder {
+public:
+	ImageThresholder(ImageView const& image, int colourThreshold);
+
+	// Thresholds row y into the words of a mask row, with the same result as thresholdRow() on the RGB32 pixels of the row.
+	void thresholdRow(int y, std::uint64_t* outWords) const;
+
+	// Pixel format and kernel, for the log
+	std::string const& getKernelName() const;
+private:
+	typedef void (*RowKernel)(std::uint8_t const* row, int width, int colourThreshold, std::uint8_t const* whiteIndices, std::uint64_t* outWords);
+
+	std::uint8_t const* m_pixels;
+	std::size_t m_bytesPerLine;
+	int m_width;
+	int m_colourThreshold;
+	RowKernel m_kernel;
+	std::string m_kernelName;
+	// 1 for the palette indices of white colours, only filled for Indexed8
+	std::uint8_t m_whiteIndices[256];
+};
+
+// Thresholds a whole image into mask, which has its size.
+void thresholdImage(ImageView const& image, int colourThreshold, BitMask& mask);
+
+#endif
@@ -1,17 +1,37 @@
 #include <QCoreApplication>
 #include <QCommandLineParser>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QImage>
+#include <QImageIOHandler>
+#include <QImageReader>
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <unordered_set>
 
 #include "AreaInformation.h"
-#include "RamerDouglasPeucker.h"
+#include "AreaLabeller.h"
+#include "BitMask.h"
+#include "ContourTracer.h"
+#include "EdgeFinder.h"
+#include "ImageWriter.h"
+#include "JobServer.h"
+#include "Log.h"
+#include "StageProfiler.h"
+#include "StageCache.h"
 #include "SvgBuilder.h"
+#include "ThreadPool.h"
 
 std::vector<QRgb> makeColors(int areaCount) {
 	std::vector<QRgb> result;
@@ -35,193 +55,210 @@ std::vector<QRgb> makeColors(int areaCount) {
 	return result;
 }
 
-inline std::size_t posToVec(int x, int y, int width) {
-	return y * width + x;
+struct OutputFiles {
+	QString svg;
+	QString bwImage;
+	QString areaImage;
+};
+
+// Inserts suffix in front of the extension of fileName
+QString addSuffix(QString const& fileName, QString const& suffix) {
+	int const extensionStart = fileName.lastIndexOf('.');
+	if (extensionStart < 0) {
+		return fileName + suffix;
+	}
+	return fileName.left(extensionStart) + suffix + fileName.mid(extensionStart);
 }
 
-void detectAreas(QImage const& image, int const colourThreshold, int const areaSizeThreshold, double const epsilon) {
-	int const width = image.width();
-	int const height = image.height();
-
-	auto const timeBwImageStart = std::chrono::steady_clock::now();
-	std::vector<bool> imageBw(width * height, false);
-	for (int h = 0; h < height; ++h) {
-		QRgb const* line = reinterpret_cast<QRgb const*>(image.scanLine(h));
-		for (int w = 0; w < width; ++w) {
-			QRgb const& rgb = line[w];
-			imageBw[posToVec(w, h, width)] = (qRed(rgb) > colourThreshold && qGreen(rgb) > colourThreshold && qBlue(rgb) > colourThreshold);
-		}
+// Names the outputs of a batch after their inputs. Inputs with the same base name, like a.png and a.jpg or scan.png in two directories,
+// get their suffix and then a counter appended, so no outputs overwrite each other. Names are compared ignoring case, as some file systems do.
+QStringList makeOutputBaseNames(QStringList const& inputFiles) {
+	std::map<QString, int> baseNameCounts;
+	for (QString const& inputFile : inputFiles) {
+		++baseNameCounts[QFileInfo(inputFile).completeBaseName().toLower()];
 	}
-	auto const timeBwImageEnd = std::chrono::steady_clock::now();
-	std::cout << "Timing - Mapping the image to black and white took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeBwImageEnd - timeBwImageStart).count() << "ms." << std::endl;
-
-	QRgb const colourBlack = QColorConstants::Black.rgb();
-	QRgb const colourWhite = QColorConstants::White.rgb();
-	auto const timeBwImageBuildStart = std::chrono::steady_clock::now();
-	QImage bwImage(width, height, QImage::Format_RGB32);
-	for (int h = 0; h < height; ++h) {
-		QRgb* line = reinterpret_cast<QRgb*>(bwImage.scanLine(h));
-		for (int w = 0; w < width; ++w) {
-			line[w] = imageBw[posToVec(w, h, width)] ? colourWhite : colourBlack;
+	QStringList baseNames;
+	std::set<QString> usedNames;
+	for (QString const& inputFile : inputFiles) {
+		QFileInfo const inputInfo(inputFile);
+		QString name = inputInfo.completeBaseName();
+		if ((baseNameCounts[name.toLower()] > 1) && !inputInfo.suffix().isEmpty()) {
+			name += "_" + inputInfo.suffix();
 		}
-	}
-	bwImage.save("imageBw.png");
-	auto const timeBwImageBuildEnd = std::chrono::steady_clock::now();
-	std::cout << "Timing - Creating and writing the black and white image took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeBwImageBuildEnd - timeBwImageBuildStart).count() << "ms." << std::endl;
-
-	auto const timeAreaCreationStart = std::chrono::steady_clock::now();
-	AreaInformation areaInformation(width, height);
-	for (int w = 0; w < width; ++w) {
-		for (int h = 0; h < height; ++h) {
-			// Always look left and up
-			bool const hasLeftArea = (w > 0) && (imageBw[posToVec(w - 1, h, width)] == imageBw[posToVec(w, h, width)]);
-			bool const hasTopArea = (h > 0) && (imageBw[posToVec(w, h - 1, width)] == imageBw[posToVec(w, h, width)]);
-			if (hasLeftArea && hasTopArea) {
-				int const topArea = areaInformation.getArea(w, h - 1);
-				int const leftArea = areaInformation.getArea(w - 1, h);
-				if (topArea == leftArea) {
-					areaInformation.setArea(w, h, leftArea);
-				} else {
-					// Merge
-					areaInformation.setArea(w, h, areaInformation.mergeAreas(topArea, leftArea));
-				}
-			} else if (hasLeftArea) {
-				int const leftArea = areaInformation.getArea(w - 1, h);
-				areaInformation.setArea(w, h, leftArea);
-			} else if (hasTopArea) {
-				int const topArea = areaInformation.getArea(w, h - 1);
-				areaInformation.setArea(w, h, topArea);
-			} else {
-				areaInformation.setArea(w, h, areaInformation.addArea());
-			}
+		QString uniqueName = name;
+		for (int n = 2; usedNames.count(uniqueName.toLower()) > 0; ++n) {
+			uniqueName = name + "_" + QString::number(n);
 		}
+		usedNames.insert(uniqueName.toLower());
+		baseNames.append(uniqueName);
 	}
+	return baseNames;
+}
 
-	// How many areas for real?
-	AreaInformation repackedAreas = areaInformation.packAreas();
-	auto const timeAreaCreationEnd = std::chrono::steady_clock::now();
-	std::cout << "Timing - Creating and merging the areas took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeAreaCreationEnd - timeAreaCreationStart).count() << "ms." << std::endl;
-
-	std::cout << "Used " << areaInformation.getAreaCount() << " areas, merged to a final amount of " << repackedAreas.getAreaCount() << " areas." << std::endl;
-	
-	auto const timeSmallAreaMergingStart = std::chrono::steady_clock::now();
-	bool hadChange = false;
-	do {
-		// Now, merge all area < X
-		hadChange = false;
-		for (int i = 0; i < repackedAreas.getAreaCount(); ++i) {
-			if (repackedAreas.getAreaMemberCount(i) < areaSizeThreshold) {
-				int const newArea = repackedAreas.getLargestNeighbourArea(i);
-				if (newArea == -1) {
-					std::cerr << "Internal Error: Area has no neighbours?!" << std::endl;
-					throw;
-				}
-				repackedAreas.mergeAreas(i, newArea);
-				hadChange = true;
-			}
-		}
-		repackedAreas = repackedAreas.packAreas();
-	} while (hadChange);
-	auto const timeSmallAreaMergingEnd = std::chrono::steady_clock::now();
-	std::cout << "Timing - Merging the small areas areas took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeSmallAreaMergingEnd - timeSmallAreaMergingStart).count() << "ms." << std::endl;
-
-	std::cout << "Merging small areas brings us to a final amount of " << repackedAreas.getAreaCount() << " areas." << std::endl;
-	for (int i = 0; i < repackedAreas.getAreaCount(); ++i) {
-		std::cout << "\tArea " << i << " has " << repackedAreas.getAreaMemberCount(i) << " members." << std::endl;
-	}
-
-	auto const timeAreaImageCreationStart = std::chrono::steady_clock::now();
-	std::vector<QRgb> const colours = makeColors(repackedAreas.getAreaCount());
-	QImage areaImage(width, height, QImage::Format_RGB32);
-	for (int h = 0; h < height; ++h) {
-		QRgb* line = reinterpret_cast<QRgb*>(areaImage.scanLine(h));
-		for (int w = 0; w < width; ++w) {
-			int const resolvedArea = repackedAreas.getArea(w, h);
-			line[w] = colours[resolvedArea];
+// Parses a comma separated list of values for a parameter sweep, none of them below minimum
+bool parseIntegerList(QString const& string, int minimum, std::vector<int>& values) {
+	values.clear();
+	for (QString const& part : string.split(',')) {
+		bool ok = false;
+		values.push_back(part.trimmed().toInt(&ok));
+		if (!ok || (values.back() < minimum)) {
+			return false;
 		}
 	}
-	areaImage.save("imageArea.png");
-	auto const timeAreaImageCreationEnd = std::chrono::steady_clock::now();
-	std::cout << "Timing - Creating and writing the area image took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeAreaImageCreationEnd - timeAreaImageCreationStart).count() << "ms." << std::endl;
-
-	auto const timeLineFormingStart = std::chrono::steady_clock::now();
-	auto const listOfLinesPerArea = repackedAreas.getListOfLinesPerArea();
-	auto const timeLineFormingEnd = std::chrono::steady_clock::now();
-	std::cout << "Timing - Forming lines from the points took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeLineFormingEnd - timeLineFormingStart).count() << "ms." << std::endl;
-
-	std::vector<std::vector<Point>> outLines;
-	std::size_t pointCountBeforeRdp = 0;
-	std::size_t pointCountAfterRdp = 0;
-	std::size_t linesRemovedFromDeduplication = 0;
-	std::size_t maxPointCountPerLineBefore = 0;
-	std::size_t maxPointCountPerLineAfter = 0;
-
-	// We will save a single point of each line, and if another line comes closer than a small epsilon, we will consider them identical and remove one.
-	std::vector<Point> deduplicationMarkerPoints;
-	double const deduplicationEpsilon = 2.0;
-
-	auto const timeLineDedupAndRdpStart = std::chrono::steady_clock::now();
-	for (int i = 0; i < repackedAreas.getAreaCount(); ++i) {
-		auto const& lines = listOfLinesPerArea.at(i);
-		for (std::size_t j = 0; j < lines.size(); ++j) {
-			auto const& line = lines.at(j);
-
-			bool isDuplicate = false;
-			if (deduplicationMarkerPoints.size() > 0) {
-				for (std::size_t k = 0; (k < line.size()) && (!isDuplicate); ++k) {
-					auto const& p = line.at(k);
-					for (auto it = deduplicationMarkerPoints.cbegin(); it != deduplicationMarkerPoints.cend(); ++it) {
-						if (AreaInformation::pointDistance(p, *it) < deduplicationEpsilon) {
-							isDuplicate = true;
-							break;
-						}
-					}
-				}
-			}
-			
-			if (isDuplicate) {
-				++linesRemovedFromDeduplication;
-				continue;
-			}
-			deduplicationMarkerPoints.push_back(*line.cbegin());
+	return !values.empty();
+}
 
-			pointCountBeforeRdp += line.size();
-			if (line.size() > maxPointCountPerLineBefore) {
-				maxPointCountPerLineBefore = line.size();
-			}
-			if (line.size() > 2) {
-				std::vector<Point> out;
-				RamerDouglasPeucker(line, epsilon, out);
-				pointCountAfterRdp += out.size();
-				if (out.size() > maxPointCountPerLineAfter) {
-					maxPointCountPerLineAfter = out.size();
-				}
-				outLines.push_back(std::move(out));
-			} else {
-				pointCountAfterRdp += line.size();
-				outLines.push_back(line);
-			}
+bool parseNumberList(QString const& string, double minimum, std::vector<double>& values) {
+	values.clear();
+	for (QString const& part : string.split(',')) {
+		bool ok = false;
+		values.push_back(part.trimmed().toDouble(&ok));
+		if (!ok || !(values.back() >= minimum)) {
+			return false;
 		}
 	}
-	auto const timeLineDedupAndRdpEnd = std::chrono::steady_clock::now();
-	std::cout << "Timing - Deduplication of lines and applying RDP took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeLineDedupAndRdpEnd - timeLineDedupAndRdpStart).count() << "ms." << std::endl;
-	std::cout << "We got " << outLines.size() << " lines (removed from deduplication: " << linesRemovedFromDeduplication << ") with " << pointCountBeforeRdp << " points (longest: " << maxPointCountPerLineBefore << " points, average: " << (pointCountBeforeRdp / outLines.size()) << " points)." << std::endl;
-	std::cout << "After applying RDP, we have " << outLines.size() << " lines with " << pointCountAfterRdp << " points (longest: " << maxPointCountPerLineAfter << ", average: " << (pointCountAfterRdp / outLines.size()) << ")." << std::endl;
+	return !values.empty();
+}
+
+template<typename T>
+std::string joinValues(std::vector<T> const& values) {
+	std::ostringstream result;
+	for (std::size_t i = 0; i < values.size(); ++i) {
+		result << ((i > 0) ? ", " : "") << values[i];
+	}
+	return result.str();
+}
 
+void writeSvg(EdgeFinderResult const& result, QString const& svgFileName, StageProfiler& profiler) {
 	double const targetW = 297.0;
 	double const targetH = 210.0;
-	auto const timeSvgBuildingStart = std::chrono::steady_clock::now();
-	SvgBuilder svgBuilder(width, height, targetW, targetH);
-	QFile svgFile("image.svg");
+	profiler.beginStage("svg");
+	SvgBuilder svgBuilder(result.width, result.height, targetW, targetH, result.crop.x, result.crop.y);
+	QFile svgFile(svgFileName);
 	if (!svgFile.open(QFile::WriteOnly)) {
 		std::cerr << "Failed to open SVG output!" << std::endl;
 		throw;
 	}
-	svgFile.write(svgBuilder.buildSvgFromLines(outLines).toUtf8());
+	if (!svgBuilder.writeSvgFromLines(result.lines, svgFile)) {
+		std::cerr << "Failed to write SVG output!" << std::endl;
+		throw;
+	}
 	svgFile.close();
-	auto const timeSvgBuildingEnd = std::chrono::steady_clock::now();
-	std::cout << "Timing - SVG creation and writing took " << std::chrono::duration_cast<std::chrono::milliseconds>(timeSvgBuildingEnd - timeSvgBuildingStart).count() << "ms." << std::endl;
-	std::cout << "Wrote SVG file to disk." << std::endl;
+	logStream(LogLevel::Normal) << "Timing - SVG creation and writing took " << profiler.endStage().getWallMilliseconds() << "ms." << std::endl;
+	profiler.addCounter("svgBytes", svgFile.size());
+	logStream(LogLevel::Normal) << "Wrote SVG file to disk." << std::endl;
+}
+
+// The pixels around a crop look like its margin next to them
+int getCropCoordinate(int imageCoordinate, int cropStart, int cropSize) {
+	return std::clamp(imageCoordinate - cropStart, 0, cropSize - 1);
+}
+
+// Writes the diagnostic images of the next image as soon as the pipeline has their contents. In a sweep, their names get the values they depend on.
+void setImageCallbacks(EdgeFinder& edgeFinder, bool writeBwImage, bool writeAreaImage, OutputFiles const& outputFiles, bool isSweep, ImageWriter& imageWriter, StageProfiler& profiler) {
+	if (writeBwImage) {
+		edgeFinder.setBlackWhiteMaskCallback([&imageWriter, &profiler, isSweep, bwImageFile = outputFiles.bwImage](BitMask const& imageBw, ImageCrop const& crop, EdgeFinderOptions const& options) {
+			QString const fileName = isSweep ? addSuffix(bwImageFile, "_c" + QString::number(options.colourThreshold)) : bwImageFile;
+			int const width = crop.imageWidth;
+			int const height = crop.imageHeight;
+			QRgb const colourBlack = QColorConstants::Black.rgb();
+			QRgb const colourWhite = QColorConstants::White.rgb();
+			profiler.beginStage("bwImage");
+			QImage bwImage(width, height, QImage::Format_RGB32);
+			for (int h = 0; h < height; ++h) {
+				QRgb* line = reinterpret_cast<QRgb*>(bwImage.scanLine(h));
+				int const y = getCropCoordinate(h, crop.y, crop.height);
+				for (int w = 0; w < width; ++w) {
+					line[w] = imageBw.get(getCropCoordinate(w, crop.x, crop.width), y) ? colourWhite : colourBlack;
+				}
+			}
+			imageWriter.save(bwImage, fileName);
+			logStream(LogLevel::Normal) << "Timing - Creating " << (imageWriter.isAsynchronous() ? "" : "and writing ") << "the black and white image took " << profiler.endStage().getWallMilliseconds() << "ms" << (imageWriter.isAsynchronous() ? " (it is written in the background)" : "") << "." << std::endl;
+		});
+	}
+
+	if (writeAreaImage) {
+		edgeFinder.setAreasCallback([&imageWriter, &profiler, isSweep, areaImageFile = outputFiles.areaImage](AreaInformation const& areas, ImageCrop const& crop, EdgeFinderOptions const& options) {
+			QString const fileName = isSweep ? addSuffix(areaImageFile, "_c" + QString::number(options.colourThreshold) + "_a" + QString::number(options.areaSizeThreshold)) : areaImageFile;
+			int const width = crop.imageWidth;
+			int const height = crop.imageHeight;
+			profiler.beginStage("areaImage");
+			std::vector<QRgb> const colours = makeColors(areas.getAreaCount());
+			QImage areaImage(width, height, QImage::Format_RGB32);
+			for (int h = 0; h < height; ++h) {
+				QRgb* line = reinterpret_cast<QRgb*>(areaImage.scanLine(h));
+				int const y = getCropCoordinate(h, crop.y, crop.height);
+				for (int w = 0; w < width; ++w) {
+					int const resolvedArea = areas.getArea(getCropCoordinate(w, crop.x, crop.width), y);
+					line[w] = colours[resolvedArea];
+				}
+			}
+			imageWriter.save(areaImage, fileName);
+			logStream(LogLevel::Normal) << "Timing - Creating " << (imageWriter.isAsynchronous() ? "" : "and writing ") << "the area image took " << profiler.endStage().getWallMilliseconds() << "ms" << (imageWriter.isAsynchronous() ? " (it is written in the background)" : "") << "." << std::endl;
+		});
+	}
+}
+
+// Reads the image a strip of rows at a time, so the labels are never held in full, and neither is the image for formats that can be read in parts.
+// Every strip opens its own reader with a clip rect. Sequential formats like JPEG still decode (or at least skip through) all rows above the clip,
+// so the decoding work grows with the number of strips times the height: memory stays bounded, time does not.
+// Returns the size of the image, which is invalid if it could not be read.
+QSize processInStrips(QString const& inputFile, EdgeFinder& edgeFinder, int stripHeight, QString const& svgFileName, StageProfiler& profiler) {
+	QImageReader sizeReader(inputFile);
+	QSize const imageSize = sizeReader.size();
+	if (!imageSize.isValid()) {
+		std::cerr << "Input image '" << inputFile.toStdString() << "' could not be read!" << std::endl;
+		return QSize();
+	}
+	int const width = imageSize.width();
+	int const height = imageSize.height();
+	logStream(LogLevel::Normal) << "Input image has dimensions " << width << " x " << height << ", processing it in strips of " << stripHeight << " rows." << std::endl;
+	profiler.beginImage(inputFile, width, height);
+
+	// Without clip rect support the handler would decode the whole image for every strip, so it is then decoded once and only thresholded per strip.
+	// With it, the handler only returns the rows of the strip, but may have to decode from the top of the image to get there.
+	bool const canReadStrips = sizeReader.supportsOption(QImageIOHandler::ClipRect);
+	if (!canReadStrips) {
+		logStream(LogLevel::Normal) << "Note: The image format can not be read in parts, so the image is decoded in full. Only the labels are kept per strip." << std::endl;
+	}
+	QImage fullImage;
+	QImage stripImage;
+	auto const readStrip = [&](int firstRow, int rows, ImageView& strip) {
+		if (canReadStrips) {
+			QImageReader reader(inputFile);
+			reader.setClipRect(QRect(0, firstRow, width, rows));
+			stripImage = reader.read();
+			if (stripImage.isNull() || (stripImage.width() != width) || (stripImage.height() != rows)) {
+				std::cerr << "Rows " << firstRow << " to " << (firstRow + rows - 1) << " of input image '" << inputFile.toStdString() << "' could not be read!" << std::endl;
+				return false;
+			}
+			stripImage = toSupportedFormat(stripImage);
+			strip = makeImageView(stripImage);
+			return true;
+		}
+
+		if (fullImage.isNull()) {
+			fullImage = QImage(inputFile);
+			if (fullImage.isNull()) {
+				std::cerr << "Input image '" << inputFile.toStdString() << "' could not be read!" << std::endl;
+				return false;
+			}
+			fullImage = toSupportedFormat(fullImage);
+		}
+		strip = makeImageView(fullImage);
+		strip.pixels = fullImage.constScanLine(firstRow);
+		strip.height = rows;
+		return true;
+	};
+
+	EdgeFinderResult result;
+	if (!edgeFinder.processInStrips(width, height, stripHeight, readStrip, result)) {
+		return QSize();
+	}
+	fullImage = QImage();
+	stripImage = QImage();
+	writeSvg(result, svgFileName, profiler);
+	return imageSize;
 }
 
 int main(int argc, char* argv[]) {
@@ -234,58 +271,347 @@ int main(int argc, char* argv[]) {
 	parser.setApplicationDescription("EdgeFinder");
 	parser.addHelpOption();
 	parser.addVersionOption();
-	parser.addPositionalArgument("image", QCoreApplication::translate("main", "Path to input image"));
-	parser.addOption(QCommandLineOption("epsilon", "Epsilon for the Ramer-Douglas-Peucker algoritm", "epsilon", "0.01"));
-	parser.addOption(QCommandLineOption("areaSizeThreshold", "Threshold for small area deletion", "areaSizeThreshold", "500"));
-	parser.addOption(QCommandLineOption("colourThreshold", "Threshold for  deciding between black and white", "colourThreshold", "64"));
+	parser.addPositionalArgument("images", QCoreApplication::translate("main", "Paths to input images or directories of images"));
+	parser.addOption(QCommandLineOption("epsilon", "Epsilon for the Ramer-Douglas-Peucker algoritm, or a comma separated list of values to sweep", "epsilon", "0.01"));
+	parser.addOption(QCommandLineOption("areaSizeThreshold", "Threshold for small area deletion, or a comma separated list of values to sweep", "areaSizeThreshold", "500"));
+	parser.addOption(QCommandLineOption("colourThreshold", "Threshold for  deciding between black and white, or a comma separated list of values to sweep", "colourThreshold", "64"));
+	parser.addOption(QCommandLineOption("deduplicationEpsilon", "Lines with a point closer than this to the start of an earlier line are dropped as duplicates, 0 to disable", "deduplicationEpsilon", "2.0"));
+	parser.addOption(QCommandLineOption("labeller", "Engine for labelling the areas, either 'runs' or 'pixel'", "labeller", "runs"));
+	parser.addOption(QCommandLineOption("lineFormer", "Engine for forming lines from the area boundaries, either 'points' or 'contour'", "lineFormer", "points"));
+	parser.addOption(QCommandLineOption("noCrop", "Run the stages on the whole images instead of only on the box around the pixels that differ from the top left one"));
+	parser.addOption(QCommandLineOption("threads", "Number of worker threads, 0 for one per hardware thread", "threads", "0"));
+	parser.addOption(QCommandLineOption("noBwImage", "Do not write the black and white image imageBw.png"));
+	parser.addOption(QCommandLineOption("noAreaImage", "Do not write the area image imageArea.png"));
+	parser.addOption(QCommandLineOption("asyncImages", "Encode and write the diagnostic images on a background thread while the pipeline continues"));
+	parser.addOption(QCommandLineOption("stripHeight", "Process the images in strips of this many rows to bound the memory use, always tracing contours and without the diagnostic images. 0 to process them in full", "stripHeight", "0"));
+	parser.addOption(QCommandLineOption("profile", "Write a JSON report with wall time, CPU time, peak RSS and counters of every stage to this file", "profile"));
+	parser.addOption(QCommandLineOption("logLevel", "Amount of output, 'quiet' for errors only, 'normal' for settings and timings or 'verbose' to also list every area", "logLevel", "normal"));
+	parser.addOption(QCommandLineOption("serve", "Serve jobs given as JSON lines on stdin and answer them as JSON lines on stdout, see JobServer.h, instead of processing images"));
+	parser.addOption(QCommandLineOption("maxJobs", "Number of jobs processed at the same time with --serve", "maxJobs", "1"));
+	parser.addOption(QCommandLineOption("cacheDirectory", "Keep the black and white mask, the areas and the lines of every image in this directory, and start from them when an image is processed again with the same parameters", "cacheDirectory"));
+	parser.addOption(QCommandLineOption("preview", "Process a downsampled copy of the images to check the thresholds quickly, and report the counts to expect at full resolution"));
+	parser.addOption(QCommandLineOption("previewScale", "Downsampling factor for --preview, 0 to pick the smallest power of two that gets the image down to about a megapixel", "previewScale", "0"));
+	parser.addOption(QCommandLineOption("previewRefine", "With --preview, move the points of the lines onto the full resolution outlines nearby"));
+	parser.addOption(QCommandLineOption("outputDirectory", "Directory for the outputs, which are then named after their input images. Used by default for more than one input", "outputDirectory"));
 
 	// Process the actual command line arguments given by the user
 	parser.process(app);
 
 	QStringList args = parser.positionalArguments();
-	if (args.size() != 1) {
+	bool const isServing = parser.isSet("serve");
+	if (args.isEmpty() && !isServing) {
 		std::cerr << "Missing command line arguments, quiting..." << std::endl;
 		return 2;
 	}
 
+	QString const logLevelString = parser.value("logLevel");
+	if (logLevelString == "quiet") {
+		setLogLevel(LogLevel::Quiet);
+	} else if (logLevelString == "normal") {
+		setLogLevel(LogLevel::Normal);
+	} else if (logLevelString == "verbose") {
+		setLogLevel(LogLevel::Verbose);
+	} else {
+		std::cerr << "Log level could not be parsed, expected 'quiet', 'normal' or 'verbose': '" << logLevelString.toStdString() << "'" << std::endl;
+		return -1;
+	}
+	if (isServing) {
+		// stdout carries the responses
+		setLogLevel(LogLevel::Quiet);
+	}
+
 	QString const epsilonString = parser.value("epsilon");
-	bool ok = false;
-	double const epsilon = epsilonString.toDouble(&ok);
-	if (!ok) {
+	std::vector<double> epsilons;
+	if (!parseNumberList(epsilonString, 0.0, epsilons)) {
 		std::cerr << "Epsilon for RDP algorithmus could not be parsed: '" << epsilonString.toStdString() << "'" << std::endl;
 		return -1;
 	}
-	std::cout << "Using epsilon = " << epsilon << " for the RDP algorithmus." << std::endl;
+	logStream(LogLevel::Normal) << "Using epsilon = " << joinValues(epsilons) << " for the RDP algorithmus." << std::endl;
 
 	QString const areaSizeThresholdString = parser.value("areaSizeThreshold");
-	ok = false;
-	int const areaSizeThreshold = areaSizeThresholdString.toInt(&ok);
-	if (!ok) {
+	std::vector<int> areaSizeThresholds;
+	if (!parseIntegerList(areaSizeThresholdString, 0, areaSizeThresholds)) {
 		std::cerr << "Threshold for small area deletion could not be parsed: '" << areaSizeThresholdString.toStdString() << "'" << std::endl;
 		return -1;
 	}
-	std::cout << "Using threshold = " << areaSizeThreshold << " for small area deletion." << std::endl;
+	logStream(LogLevel::Normal) << "Using threshold = " << joinValues(areaSizeThresholds) << " for small area deletion." << std::endl;
 
 	QString const colourThresholdString = parser.value("colourThreshold");
-	ok = false;
-	int const colourThreshold = colourThresholdString.toInt(&ok);
-	if (!ok) {
+	std::vector<int> colourThresholds;
+	if (!parseIntegerList(colourThresholdString, std::numeric_limits<int>::min(), colourThresholds)) {
 		std::cerr << "Threshold for black/white decision could not be parsed: '" << colourThresholdString.toStdString() << "'" << std::endl;
 		return -1;
 	}
-	std::cout << "Using threshold = " << colourThreshold << " for black/white decision (every RGB component > threshold => white)." << std::endl;
+	logStream(LogLevel::Normal) << "Using threshold = " << joinValues(colourThresholds) << " for black/white decision (every RGB component > threshold => white)." << std::endl;
+
+	QString const deduplicationEpsilonString = parser.value("deduplicationEpsilon");
+	bool ok = false;
+	double const deduplicationEpsilon = deduplicationEpsilonString.toDouble(&ok);
+	if (!ok || !(deduplicationEpsilon >= 0.0)) {
+		std::cerr << "Epsilon for line deduplication could not be parsed: '" << deduplicationEpsilonString.toStdString() << "'" << std::endl;
+		return -1;
+	}
+	logStream(LogLevel::Normal) << "Using epsilon = " << deduplicationEpsilon << " for line deduplication." << std::endl;
+
+	QString const labellerString = parser.value("labeller");
+	LabellerType labellerType = LabellerType::Runs;
+	if (labellerString == "runs") {
+		labellerType = LabellerType::Runs;
+	} else if (labellerString == "pixel") {
+		labellerType = LabellerType::Pixel;
+	} else {
+		std::cerr << "Labeller could not be parsed, expected 'runs' or 'pixel': '" << labellerString.toStdString() << "'" << std::endl;
+		return -1;
+	}
+	logStream(LogLevel::Normal) << "Using the '" << labellerString.toStdString() << "' labeller for area detection." << std::endl;
+
+	QString const lineFormerString = parser.value("lineFormer");
+	LineFormerType lineFormerType = LineFormerType::PointSearch;
+	if (lineFormerString == "points") {
+		lineFormerType = LineFormerType::PointSearch;
+	} else if (lineFormerString == "contour") {
+		lineFormerType = LineFormerType::Contour;
+	} else {
+		std::cerr << "Line former could not be parsed, expected 'points' or 'contour': '" << lineFormerString.toStdString() << "'" << std::endl;
+		return -1;
+	}
+	logStream(LogLevel::Normal) << "Using the '" << lineFormerString.toStdString() << "' line former." << std::endl;
+
+	QString const threadsString = parser.value("threads");
+	ok = false;
+	int threadCount = threadsString.toInt(&ok);
+	if (!ok || threadCount < 0) {
+		std::cerr << "Number of threads could not be parsed: '" << threadsString.toStdString() << "'" << std::endl;
+		return -1;
+	}
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	logStream(LogLevel::Normal) << "Using " << threadCount << " thread(s)." << std::endl;
+	if (parser.isSet("asyncImages")) {
+		logStream(LogLevel::Normal) << "Writing the diagnostic images in the background." << std::endl;
+	}
+
+	QString const stripHeightString = parser.value("stripHeight");
+	ok = false;
+	int const stripHeight = stripHeightString.toInt(&ok);
+	if (!ok || stripHeight < 0) {
+		std::cerr << "Strip height could not be parsed: '" << stripHeightString.toStdString() << "'" << std::endl;
+		return -1;
+	}
+	if (stripHeight > 0) {
+		logStream(LogLevel::Normal) << "Processing the images in strips of " << stripHeight << " rows. Outlines are traced as contours and no diagnostic images are written." << std::endl;
+	}
+
+	QString const maxJobsString = parser.value("maxJobs");
+	ok = false;
+	int const maxJobs = maxJobsString.toInt(&ok);
+	if (!ok || maxJobs < 1) {
+		std::cerr << "Number of concurrent jobs could not be parsed: '" << maxJobsString.toStdString() << "'" << std::endl;
+		return -1;
+	}
+
+	QString const previewScaleString = parser.value("previewScale");
+	ok = false;
+	int const previewScale = previewScaleString.toInt(&ok);
+	if (!ok || previewScale < 0) {
+		std::cerr << "Preview scale could not be parsed: '" << previewScaleString.toStdString() << "'" << std::endl;
+		return -1;
+	}
+	bool const isPreview = parser.isSet("preview");
+	if (isPreview && ((stripHeight > 0) || isServing)) {
+		std::cerr << "A preview can not be made with --stripHeight or --serve!" << std::endl;
+		return -1;
+	}
 
-	if (!QFile::exists(args[0])) {
-		std::cerr << "Input image '" << args[0].toStdString() << "' does not exist!" << std::endl;
+	// More than one value for a parameter sweeps all combinations, with one SVG each
+	EdgeFinderSweep sweep;
+	sweep.colourThresholds = colourThresholds;
+	sweep.areaSizeThresholds = areaSizeThresholds;
+	sweep.epsilons = epsilons;
+	bool const isSweep = (colourThresholds.size() > 1) || (areaSizeThresholds.size() > 1) || (epsilons.size() > 1);
+	if (isSweep && ((stripHeight > 0) || isServing || isPreview)) {
+		std::cerr << "Lists of values can not be swept with --stripHeight, --serve or --preview!" << std::endl;
 		return -1;
 	}
-	QImage image(args[0]);
-	std::cout << "Input image has dimensions " << image.width() << " x " << image.height() << "." << std::endl;
+	if (isSweep) {
+		logStream(LogLevel::Normal) << "Sweeping " << (colourThresholds.size() * areaSizeThresholds.size() * epsilons.size()) << " combinations of the parameters, the outputs are named after their values." << std::endl;
+	}
+
+	EdgeFinderOptions options;
+	options.colourThreshold = colourThresholds.front();
+	options.areaSizeThreshold = areaSizeThresholds.front();
+	options.epsilon = epsilons.front();
+	options.deduplicationEpsilon = deduplicationEpsilon;
+	options.labellerType = labellerType;
+	options.lineFormerType = lineFormerType;
+	options.isCropping = !parser.isSet("noCrop");
+
+	if (isServing) {
+		// The worker threads and the pipelines of the job slots stay warm until stdin ends or a quit command arrives
+		ThreadPool threadPool(threadCount);
+		JobServer jobServer(options, threadPool, maxJobs, std::cout);
+		std::cerr << "Serving jobs on stdin with " << maxJobs << " job(s) at a time on " << threadCount << " thread(s)." << std::endl;
+		jobServer.run(std::cin);
+		return 0;
+	}
+
+	// Directories contribute the images in them, in name order
+	QStringList const imageNameFilters = { "*.png", "*.jpg", "*.jpeg", "*.bmp", "*.gif", "*.tif", "*.tiff", "*.webp" };
+	QStringList inputFiles;
+	bool hasDirectoryInput = false;
+	for (QString const& arg : args) {
+		QFileInfo const argInfo(arg);
+		if (argInfo.isDir()) {
+			QDir const directory(arg);
+			for (QString const& entry : directory.entryList(imageNameFilters, QDir::Files, QDir::Name)) {
+				inputFiles.append(directory.filePath(entry));
+			}
+			hasDirectoryInput = true;
+		} else if (argInfo.exists()) {
+			inputFiles.append(arg);
+		} else {
+			std::cerr << "Input image '" << arg.toStdString() << "' does not exist!" << std::endl;
+			return -1;
+		}
+	}
+	if (inputFiles.isEmpty()) {
+		std::cerr << "No input images found, quiting..." << std::endl;
+		return 2;
+	}
 
-	detectAreas(image, colourThreshold, areaSizeThreshold, epsilon);
+	// A single image keeps the fixed output names, batches name the outputs after their inputs
+	bool const isBatch = (inputFiles.size() > 1) || hasDirectoryInput || parser.isSet("outputDirectory");
+	QDir const outputDirectory(parser.isSet("outputDirectory") ? parser.value("outputDirectory") : QString("."));
+	if (isBatch) {
+		if (!outputDirectory.mkpath(".")) {
+			std::cerr << "Output directory '" << outputDirectory.path().toStdString() << "' could not be created!" << std::endl;
+			return -1;
+		}
+		logStream(LogLevel::Normal) << "Processing " << inputFiles.size() << " image(s), writing to '" << outputDirectory.path().toStdString() << "'." << std::endl;
+	}
+	QStringList const outputBaseNames = isBatch ? makeOutputBaseNames(inputFiles) : QStringList();
+
+	bool const writeBwImage = !parser.isSet("noBwImage");
+	bool const writeAreaImage = !parser.isSet("noAreaImage");
+
+	// Shared by all images: the worker threads, the background image writer and the pipeline with its per-size buffers
+	ThreadPool threadPool(threadCount);
+	ImageWriter imageWriter(parser.isSet("asyncImages"));
+	StageProfiler profiler;
+	EdgeFinder edgeFinder(options, threadPool);
+	edgeFinder.setProfiler(&profiler);
+	StageCache stageCache(parser.value("cacheDirectory"));
+	if (parser.isSet("cacheDirectory")) {
+		if (!stageCache.isUsable()) {
+			std::cerr << "Cache directory '" << stageCache.getDirectory().toStdString() << "' could not be created!" << std::endl;
+			return -1;
+		}
+		if (isSweep || (stripHeight > 0) || isPreview) {
+			logStream(LogLevel::Normal) << "Note: Sweeps, strips and previews do not use the cache." << std::endl;
+		} else {
+			edgeFinder.setCache(&stageCache);
+		}
+		logStream(LogLevel::Normal) << "Caching the stages in '" << stageCache.getDirectory().toStdString() << "'." << std::endl;
+	}
+
+	// While one image is processed, the next one is already decoded in the background. Strips are read on demand instead.
+	auto const loadImage = [](QString const& fileName) {
+		return QImage(fileName);
+	};
+	std::future<QImage> nextImage;
+	if (stripHeight == 0) {
+		nextImage = std::async(std::launch::async, loadImage, inputFiles.at(0));
+	}
+
+	int processedImages = 0;
+	int failedImages = 0;
+	double processedMegapixels = 0.0;
+	auto const timeBatchStart = std::chrono::steady_clock::now();
+	for (int i = 0; i < inputFiles.size(); ++i) {
+		QString const& inputFile = inputFiles.at(i);
+		if (isBatch) {
+			logStream(LogLevel::Normal) << "Image " << (i + 1) << " of " << inputFiles.size() << ": '" << inputFile.toStdString() << "'." << std::endl;
+		}
+
+		OutputFiles outputFiles;
+		if (isBatch) {
+			QString const& baseName = outputBaseNames.at(i);
+			if (baseName != QFileInfo(inputFile).completeBaseName()) {
+				logStream(LogLevel::Normal) << "Another input has the same name, the outputs are named '" << baseName.toStdString() << "'." << std::endl;
+			}
+			outputFiles.svg = outputDirectory.filePath(baseName + ".svg");
+			outputFiles.bwImage = outputDirectory.filePath(baseName + "_bw.png");
+			outputFiles.areaImage = outputDirectory.filePath(baseName + "_area.png");
+		} else {
+			outputFiles.svg = "image.svg";
+			outputFiles.bwImage = "imageBw.png";
+			outputFiles.areaImage = "imageArea.png";
+		}
+
+		if (stripHeight > 0) {
+			QSize const imageSize = processInStrips(inputFile, edgeFinder, stripHeight, outputFiles.svg, profiler);
+			if (!imageSize.isValid()) {
+				++failedImages;
+				continue;
+			}
+			++processedImages;
+			processedMegapixels += (static_cast<double>(imageSize.width()) * imageSize.height()) / 1000000.0;
+			continue;
+		}
+
+		QImage const image = nextImage.get();
+		if (i + 1 < inputFiles.size()) {
+			nextImage = std::async(std::launch::async, loadImage, inputFiles.at(i + 1));
+		}
+
+		if (image.isNull()) {
+			std::cerr << "Input image '" << inputFile.toStdString() << "' could not be read!" << std::endl;
+			++failedImages;
+			continue;
+		}
+		logStream(LogLevel::Normal) << "Input image has dimensions " << image.width() << " x " << image.height() << "." << std::endl;
+
+		profiler.beginImage(inputFile, image.width(), image.height());
+		setImageCallbacks(edgeFinder, writeBwImage, writeAreaImage, outputFiles, isSweep, imageWriter, profiler);
+		QImage const supportedImage = toSupportedFormat(image);
+		if (isSweep) {
+			edgeFinder.sweep(makeImageView(supportedImage), sweep, [&](EdgeFinderOptions const& sweepOptions, EdgeFinderResult const& result) {
+				QString const suffix = "_c" + QString::number(sweepOptions.colourThreshold) + "_a" + QString::number(sweepOptions.areaSizeThreshold) + "_e" + QString::number(sweepOptions.epsilon);
+				logStream(LogLevel::Normal) << "Sweep - colourThreshold " << sweepOptions.colourThreshold << ", areaSizeThreshold " << sweepOptions.areaSizeThreshold << ", epsilon " << sweepOptions.epsilon << ": " << result.areaSizes.size() << " areas, " << result.lines.size() << " lines with " << result.statistics.pointCountAfterRdp << " points." << std::endl;
+				writeSvg(result, addSuffix(outputFiles.svg, suffix), profiler);
+			});
+		} else if (isPreview) {
+			int const scale = (previewScale > 0) ? previewScale : EdgeFinder::getPreviewScale(image.width(), image.height(), 1000000);
+			EdgeFinderPreview const preview = edgeFinder.preview(makeImageView(supportedImage), scale, parser.isSet("previewRefine"));
+			logStream(LogLevel::Normal) << "Preview - at 1/" << preview.scale << " of the size, expect about " << preview.estimatedAreaCount << " areas and " << preview.estimatedLineCount << " lines with " << preview.estimatedPointCountBeforeRdp << " points before RDP at full resolution." << std::endl;
+			writeSvg(preview.result, outputFiles.svg, profiler);
+		} else {
+			EdgeFinderResult const result = edgeFinder.process(makeImageView(supportedImage));
+			writeSvg(result, outputFiles.svg, profiler);
+		}
+		++processedImages;
+		processedMegapixels += (static_cast<double>(image.width()) * image.height()) / 1000000.0;
+	}
+	imageWriter.waitForPendingWrites();
+	auto const timeBatchEnd = std::chrono::steady_clock::now();
+
+	if (isBatch) {
+		double const batchSeconds = std::chrono::duration<double>(timeBatchEnd - timeBatchStart).count();
+		logStream(LogLevel::Normal) << "Timing - Processed " << processedImages << " image(s) (" << failedImages << " failed, " << processedMegapixels << " megapixels) in " << std::chrono::duration_cast<std::chrono::milliseconds>(timeBatchEnd - timeBatchStart).count() << "ms, that is " << ((batchSeconds > 0.0) ? (processedImages / batchSeconds) : 0.0) << " images per second (" << ((batchSeconds > 0.0) ? (processedMegapixels / batchSeconds) : 0.0) << " megapixels per second)." << std::endl;
+	}
+
+	if (parser.isSet("profile")) {
+		QString const profileFileName = parser.value("profile");
+		if (!profiler.writeJson(profileFileName)) {
+			std::cerr << "Failed to write the profile to '" << profileFileName.toStdString() << "'!" << std::endl;
+			return -1;
+		}
+		logStream(LogLevel::Normal) << "Wrote the profile to '" << profileFileName.toStdString() << "'." << std::endl;
+	}
 
-	std::cout << "Bye bye!" << std::endl;
-	return 0;
+	logStream(LogLevel::Normal) << "Bye bye!" << std::endl;
+	return (failedImages > 0) ? 1 : 0;
 }
 
 #ifdef _MSC_VER